@@ -0,0 +1,34 @@
+#pragma once
+
+// what the benchmarks share, the generated sources of the tests and a timer that keeps the best of several runs
+
+#include "../tests/generate.h"
+
+#include <chrono>
+
+// seconds the fastest of the given amount of calls to run took, prepare is called before every run without being
+// timed
+template <typename Prepare, typename Run>
+double bestOf(int runs, Prepare &&prepare, Run &&run) {
+    double best = 0;
+
+    for (int i = 0; i < runs; i++) {
+        prepare();
+
+        auto begin = std::chrono::high_resolution_clock::now();
+        run();
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - begin).count();
+
+        if (best == 0 || seconds < best)
+            best = seconds;
+    }
+
+    return best;
+}
+
+template <typename Run>
+double bestOf(int runs, Run &&run) {
+    return bestOf(runs, []() {}, run);
+}
@@ -0,0 +1,132 @@
+// compares loading raw and compressed executables, both from the page cache and with the time a slow shared
+// storage would need to deliver the bytes added. the example programs are repacked from their prebuilt images,
+// the large ones are assembled from generated source
+// build with `make bench` and run ./bench_compression [storage megabytes per second]
+
+#include "common.h"
+
+struct Program {
+    std::string name;
+    std::vector<CCA::Definition> definitions;
+    std::vector<unsigned char> bytecode;
+    std::string storage; // what the definitions point into
+};
+
+// splits a legacy image at the magic that separates the data from the code, images from before the magic was
+// introduced are taken as code only
+bool readLegacy(const std::string &fileName, Program &program) {
+    std::ifstream file(fileName, std::ios::binary);
+
+    if (!file.is_open())
+        return false;
+
+    std::string image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    size_t magic = image.find("\xDE\xAD\xBE\xEF");
+
+    if (magic == std::string::npos || image.size() < magic + 8) {
+        program.bytecode.assign(image.begin(), image.end());
+        return true;
+    }
+
+    program.storage = image.substr(0, magic);
+    program.definitions.push_back(CCA::Definition{0, program.storage, 0, 0});
+    program.bytecode.assign(image.begin() + magic + 8, image.end());
+
+    return true;
+}
+
+void assembleSource(const std::string &code, Program &program) {
+    program.storage = code;
+
+    CCA::SymbolPool symbols;
+    CCA::TokenStore tokens;
+    std::vector<CCA::Marker> markers;
+    std::vector<CCA::InstructionLayout> instructions;
+
+    CCA::lexer(program.storage, symbols, tokens);
+    CCA::parseDefinitions(tokens, program.definitions);
+    CCA::postTokenizer(tokens, markers, program.definitions, symbols);
+
+    CCA::layoutInstructions(tokens, markers, false, instructions);
+    CCA::generateBytecode(tokens, instructions, false, symbols, program.bytecode);
+
+    // the decoded strings live in the pool, which goes away here
+    size_t size = program.storage.size();
+
+    for (auto &d: program.definitions)
+        size += d.value.size();
+
+    program.storage.reserve(size);
+
+    for (auto &d: program.definitions) {
+        program.storage += d.value;
+        d.value = std::string_view(program.storage).substr(program.storage.size() - d.value.size());
+    }
+}
+
+double bestLoad(const std::string &fileName, int runs) {
+    return bestOf(runs, [&]() {
+        CCA::LoadedImage image(fileName);
+    });
+}
+
+size_t fileSize(const std::string &fileName) {
+    std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+    return file.tellg();
+}
+
+void measure(const Program &program, double bandwidth) {
+    const std::string raw = "bench_compression_raw.ccb";
+    const std::string compressed = "bench_compression_lz.ccb";
+    CCA::SymbolPool symbols;
+    std::vector<CCA::Marker> markers;
+
+    CCA::writeImage(program.definitions, markers, symbols, program.bytecode, raw, CCA::ImageOptions{});
+    CCA::writeImage(program.definitions, markers, symbols, program.bytecode, compressed,
+                    CCA::ImageOptions{false, false, true});
+
+    int runs = program.bytecode.size() > (1 << 20) ? 5 : 50;
+    size_t rawSize = fileSize(raw);
+    size_t compressedSize = fileSize(compressed);
+    double rawLoad = bestLoad(raw, runs);
+    double compressedLoad = bestLoad(compressed, runs);
+    double bytesPerSecond = bandwidth * 1024 * 1024;
+
+    std::cout << "  " << program.name << ": " << rawSize << " -> " << compressedSize << " bytes ("
+              << 100.0 * compressedSize / rawSize << "%)\n"
+              << "    cached load " << rawLoad * 1000 << " ms raw, " << compressedLoad * 1000 << " ms compressed\n"
+              << "    at " << bandwidth << " MB/s " << (rawLoad + rawSize / bytesPerSecond) * 1000 << " ms raw, "
+              << (compressedLoad + compressedSize / bytesPerSecond) * 1000 << " ms compressed\n";
+
+    std::remove(raw.c_str());
+    std::remove(compressed.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    double bandwidth = argc > 1 ? std::atof(argv[1]) : 100;
+    const char *examples[] = {"examples/HelloWorld/HelloWorld.ccb", "examples/Spam/spam.ccb",
+                              "examples/blackjack/blackjack.ccb", "examples/bottles/bottles.ccb",
+                              "examples/fib/fib.ccb"};
+
+    std::cout << "loading raw and compressed executables, best of several runs\n";
+
+    for (const char *example: examples) {
+        Program program;
+        program.name = example;
+
+        if (readLegacy(example, program))
+            measure(program, bandwidth);
+        else
+            std::cout << "  " << example << ": can't be read, run from the repository root\n";
+    }
+
+    for (size_t blocks: {10000, 100000, 1000000}) {
+        Program program;
+        program.name = "generated, " + std::to_string(blocks) + " blocks";
+
+        assembleSource(generateSource(blocks), program);
+        measure(program, bandwidth);
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+// measures lexer throughput on a large generated source for every scanning level
+// build with `make bench` and run ./bench_lexer [megabytes]
+
+#include "common.h"
+
+double measure(std::string_view code, int runs, unsigned int jobs = 1) {
+    double seconds = bestOf(runs, [&]() {
+        CCA::SymbolPool symbols;
+        CCA::TokenStore tokens;
+        CCA::lexer(code, symbols, tokens, jobs);
+    });
+
+    return code.size() / seconds / (1024 * 1024);
+}
+
+int main(int argc, char *argv[]) {
+    size_t megabytes = argc > 1 ? std::atoi(argv[1]) : 64;
+    std::string code = generateSourceOfSize(megabytes * 1024 * 1024, true);
+
+    std::cout << "lexing " << code.size() / (1024 * 1024) << " MB of generated source, best of 5 runs\n";
+
+    const std::pair<const char *, CCA::Scan::Level> levels[] = {
+            {"scalar", CCA::Scan::Level::SCALAR},
+            {"sse2", CCA::Scan::Level::SSE2},
+            {"avx2", CCA::Scan::Level::AVX2}
+    };
+
+    for (auto &level: levels) {
+        CCA::Scan::useLevel(level.second);
+        std::cout << "  " << level.first << ": " << measure(code, 5) << " MB/s\n";
+    }
+
+    CCA::Scan::useLevel(CCA::Scan::detectLevel());
+
+    for (unsigned int jobs = 2; jobs <= std::max(2u, std::thread::hardware_concurrency()); jobs *= 2)
+        std::cout << "  " << jobs << " jobs: " << measure(code, 5, jobs) << " MB/s\n";
+}
@@ -0,0 +1,99 @@
+// compares the allocation free integer parser with the std::stoi based path it replaced
+// build with `make bench` and run ./bench_numbers [millions of literals]
+
+#include "common.h"
+
+#include <bitset>
+#include <random>
+#include <sstream>
+#include <tuple>
+
+// the previous implementation, kept here only as the baseline to measure against
+int legacyParseNumber(std::string_view digits, int base) {
+    return std::stoi(std::string(digits), 0, base);
+}
+
+struct Literal {
+    std::string_view digits;
+    unsigned int base;
+};
+
+template<typename Parse>
+double measure(const std::vector<Literal> &literals, int runs, Parse &&parse) {
+    unsigned long long checksum = 0;
+
+    double seconds = bestOf(runs, [&]() {
+        for (const Literal &literal: literals)
+            checksum += parse(literal);
+    });
+
+    // keeps the parsing from being optimized away
+    if (checksum == 1)
+        std::cout << "";
+
+    return literals.size() / seconds / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    size_t millions = argc > 1 ? std::atoi(argv[1]) : 4;
+    std::string storage;
+    std::vector<std::tuple<size_t, size_t, unsigned int>> spans;
+    std::mt19937 random(1234);
+
+    // mix of short and long decimal literals and hex/binary ones, all below INT_MAX so stoi accepts them
+    for (size_t i = 0; i < millions * 1000000; i++) {
+        uint32_t value = random() & 0x7FFFFFFF;
+        std::string text;
+        unsigned int base = 10;
+
+        switch (i % 4) {
+            case 0: text = std::to_string(value & 0xFF); break;
+            case 1: text = std::to_string(value); break;
+            case 2: {
+                std::ostringstream stream;
+                stream << std::hex << value;
+                text = stream.str();
+                base = 16;
+                break;
+            }
+            default: text = std::bitset<31>(value).to_string(); base = 2; break;
+        }
+
+        spans.emplace_back(storage.size(), text.size(), base);
+        storage += text;
+    }
+
+    std::vector<Literal> literals;
+    literals.reserve(spans.size());
+
+    // views are only taken once storage stopped growing
+    for (auto &[offset, size, base]: spans)
+        literals.push_back(Literal{std::string_view(storage.data() + offset, size), base});
+
+    for (const Literal &literal: literals) {
+        uint32_t value = 0;
+
+        if (!CCA::parseInteger(literal.digits, literal.base, value) ||
+            value != static_cast<uint32_t>(legacyParseNumber(literal.digits, literal.base))) {
+            std::cout << "mismatch on " << literal.digits << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << "parsing " << literals.size() << " literals, best of 5 runs\n";
+
+    double legacy = measure(literals, 5, [](const Literal &literal) {
+        return static_cast<uint32_t>(legacyParseNumber(literal.digits, literal.base));
+    });
+
+    double current = measure(literals, 5, [](const Literal &literal) {
+        uint32_t value = 0;
+        CCA::parseInteger(literal.digits, literal.base, value);
+        return value;
+    });
+
+    std::cout << "  stoi          " << legacy << " M literals/s\n";
+    std::cout << "  parseInteger  " << current << " M literals/s\n";
+
+    return 0;
+}
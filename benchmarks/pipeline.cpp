@@ -0,0 +1,64 @@
+// compares the batch pipeline, which finishes every pass over all tokens before the next one starts, with the pull
+// pipeline of --single-pass, which moves the tokens through every stage a window at a time, and with --pipeline,
+// which lexes on a second thread while the first one assembles. all of them encode with the wide forms so they
+// produce the same bytecode. --pipeline can only be faster with a core for each thread
+// build with `make bench` and run ./bench_pipeline [blocks]
+
+#include "common.h"
+
+template <typename Lexer>
+std::vector<unsigned char> stream(std::string_view code) {
+    CCA::StreamAssembler assembler(true);
+    CCA::LexState state;
+
+    {
+        Lexer lexed(code, state, assembler.getSymbols());
+        CCA::DeclarationFilter<Lexer, CCA::StreamAssembler> declared(lexed, assembler);
+
+        assembler.consume(declared);
+        declared.finish();
+    }
+
+    assembler.finish();
+    return assembler.getBytecode();
+}
+
+int main(int argc, char *argv[]) {
+    size_t blocks = argc > 1 ? std::atoi(argv[1]) : 200000;
+    std::string code = generateSource(blocks, true);
+    std::vector<unsigned char> batch;
+    std::vector<unsigned char> pulled;
+    std::vector<unsigned char> pipelined;
+
+    std::cout << "assembling " << code.size() / (1024 * 1024) << " MB of generated source, best of 5 runs\n";
+
+    double batchTime = bestOf(5, [&]() {
+        CCA::SymbolPool symbols;
+        CCA::TokenStore tokens;
+        std::vector<CCA::Definition> definitions;
+        std::vector<CCA::Marker> markers;
+        std::vector<CCA::InstructionLayout> instructions;
+
+        CCA::lexer(code, symbols, tokens);
+        CCA::parseDefinitions(tokens, definitions);
+        CCA::postTokenizer(tokens, markers, definitions, symbols);
+        CCA::layoutInstructions(tokens, markers, true, instructions);
+        CCA::generateBytecode(tokens, instructions, true, symbols, batch);
+    });
+
+    double pullTime = bestOf(5, [&]() {
+        pulled = stream<CCA::TokenGenerator>(code);
+    });
+
+    double pipelineTime = bestOf(5, [&]() {
+        pipelined = stream<CCA::PipelinedLexer>(code);
+    });
+
+    std::cout << "  batch: " << batchTime * 1000 << " ms\n"
+              << "  pull: " << pullTime * 1000 << " ms\n"
+              << "  pipeline: " << pipelineTime * 1000 << " ms on " << std::thread::hardware_concurrency()
+              << " cores\n";
+
+    if (batch != pulled || batch != pipelined)
+        std::cout << "  the pipelines produced different bytecode\n";
+}
@@ -0,0 +1,37 @@
+// measures how long collecting and resolving symbols takes as the amount of labels grows, the time per label
+// should stay flat. build with `make bench` and run ./bench_symbols [largest label count]
+
+#include "common.h"
+
+double measure(std::string_view code, int runs) {
+    CCA::SymbolPool symbols;
+    CCA::TokenStore tokens;
+    std::vector<CCA::Marker> markers;
+    std::vector<CCA::Definition> definitions;
+
+    // collecting the symbols consumes the tokens, so they are lexed again before every run
+    return bestOf(runs, [&]() {
+        symbols.clear();
+        markers.clear();
+        CCA::lexer(code, symbols, tokens);
+    }, [&]() {
+        CCA::parseDefinitions(tokens, definitions);
+        CCA::postTokenizer(tokens, markers, definitions, symbols);
+    });
+}
+
+int main(int argc, char *argv[]) {
+    size_t largest = argc > 1 ? std::atoi(argv[1]) : 400000;
+
+    std::cout << "symbol collection and resolution, best of 3 runs\n";
+
+    for (size_t labels = 25000; labels <= largest; labels *= 2) {
+        std::string code = generateSource(labels);
+        double seconds = measure(code, 3);
+
+        std::cout << "  " << labels << " labels: " << seconds * 1000 << " ms, "
+                  << seconds * 1e9 / labels << " ns per label\n";
+    }
+
+    return 0;
+}
@@ -4,20 +4,46 @@
 #include <cstdlib>
 #include <streambuf>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
 #include <chrono>
 #include <map>
+#include <deque>
+#include <memory>
+#include <numeric>
+#include <limits>
+#include <unordered_map>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <thread>
 #include <math.h>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
 
 // other libraries
 #include <termcolor/termcolor.hpp>
 #include <cxxopt/cxxopt.hpp>
 #include <FileWatcher/FileWatcher.h>
 
+#include <cca/scan.h>
+#include <cca/dfa.h>
+#include <cca/lz.h>
+#include <cca/ring.h>
+
 #define CCBC_VERSION (char)0x00, (char)0x01, (char)0x00, (char)0x00
-#define CCVM_OPCODES {"STP", "MOV", "RAND", "PSH", "POP", "SYS"}
+#define CCBC_CONTAINER_VERSION (char)0x00, (char)0x02, (char)0x00, (char)0x00
 #define CCVM_REGISTERS { "a", "b", "c", "d", "e", "f", "g", "h" }
+// encodings that take immediates can list two more opcodes, the variants where every immediate is stored in 8
+// or 16 bits instead of 32
 #define CCVM_INSTRUCTION_SET {\
     { "STP", {\
         {0x00, {}} }},\
@@ -38,65 +64,65 @@
     { "RET", {\
         {0x09, {TokenType::ADDRESS}} }},\
     { "MOV", {\
-        {0x10, {TokenType::REGISTER, TokenType::NUMBER}},\
+        {0x10, {TokenType::REGISTER, TokenType::NUMBER}, 0x80, 0xA0},\
         {0x11, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x12, {TokenType::REGISTER, TokenType::ADDRESS}},\
-        {0x13, {TokenType::ADDRESS, TokenType::REGISTER}},\
-        {0x14, {TokenType::ADDRESS, TokenType::NUMBER}},\
-        {0x15, {TokenType::ADDRESS, TokenType::ADDRESS}} }},\
+        {0x12, {TokenType::REGISTER, TokenType::ADDRESS}, 0x81, 0xA1},\
+        {0x13, {TokenType::ADDRESS, TokenType::REGISTER}, 0x82, 0xA2},\
+        {0x14, {TokenType::ADDRESS, TokenType::NUMBER}, 0x83, 0xA3},\
+        {0x15, {TokenType::ADDRESS, TokenType::ADDRESS}, 0x84, 0xA4} }},\
     { "PSH", {\
         {0x16, {TokenType::REGISTER}},\
-        {0x17, {TokenType::NUMBER}},\
-        {0x17, {TokenType::ADDRESS}} }},\
+        {0x17, {TokenType::NUMBER}, 0x85, 0xA5},\
+        {0x17, {TokenType::ADDRESS}, 0x9C, 0xBC} }},\
     { "POP", {\
         {0x18, {TokenType::REGISTER}},\
-        {0x19, {TokenType::ADDRESS}} }},\
+        {0x19, {TokenType::ADDRESS}, 0x86, 0xA6} }},\
     { "ALLOC", {\
         {0x1A, {}},\
-        {0x1B, {TokenType::NUMBER}},\
+        {0x1B, {TokenType::NUMBER}, 0x87, 0xA7},\
         {0x1C, {TokenType::REGISTER}},\
-        {0x1D, {TokenType::ADDRESS}} }},\
+        {0x1D, {TokenType::ADDRESS}, 0x88, 0xA8} }},\
     { "FREE", {\
         {0x1E, {}},\
-        {0x1F, {TokenType::NUMBER}},\
+        {0x1F, {TokenType::NUMBER}, 0x89, 0xA9},\
         {0x20, {TokenType::REGISTER}},\
-        {0x21, {TokenType::ADDRESS}} }},\
+        {0x21, {TokenType::ADDRESS}, 0x8A, 0xAA} }},\
     { "REALLOC", {\
         {0x22, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x23, {TokenType::REGISTER, TokenType::ADDRESS}},\
-        {0x24, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x25, {TokenType::ADDRESS, TokenType::REGISTER}},\
-        {0x26, {TokenType::ADDRESS, TokenType::ADDRESS}},\
-        {0x27, {TokenType::ADDRESS, TokenType::LITERAL}} }},\
+        {0x23, {TokenType::REGISTER, TokenType::ADDRESS}, 0x8B, 0xAB},\
+        {0x24, {TokenType::REGISTER, TokenType::NUMBER}, 0x8C, 0xAC},\
+        {0x25, {TokenType::ADDRESS, TokenType::REGISTER}, 0x8D, 0xAD},\
+        {0x26, {TokenType::ADDRESS, TokenType::ADDRESS}, 0x8E, 0xAE},\
+        {0x27, {TokenType::ADDRESS, TokenType::NUMBER}, 0x8F, 0xAF} }},\
     { "ADD", {\
         {0x60, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x61, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x62, {TokenType::REGISTER, TokenType::ADDRESS}},\
+        {0x61, {TokenType::REGISTER, TokenType::NUMBER}, 0x90, 0xB0},\
+        {0x62, {TokenType::REGISTER, TokenType::ADDRESS}, 0x91, 0xB1},\
         {0x63, {}} }},\
     { "SUB", {\
         {0x64, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x65, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x66, {TokenType::REGISTER, TokenType::ADDRESS}},\
+        {0x65, {TokenType::REGISTER, TokenType::NUMBER}, 0x92, 0xB2},\
+        {0x66, {TokenType::REGISTER, TokenType::ADDRESS}, 0x93, 0xB3},\
         {0x67, {}} }},\
     { "DIV", {\
         {0x68, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x69, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x6A, {TokenType::REGISTER, TokenType::ADDRESS}},\
+        {0x69, {TokenType::REGISTER, TokenType::NUMBER}, 0x94, 0xB4},\
+        {0x6A, {TokenType::REGISTER, TokenType::ADDRESS}, 0x95, 0xB5},\
         {0x6B, {}} }},\
     { "MUL", {\
         {0x6C, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x6D, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x6E, {TokenType::REGISTER, TokenType::ADDRESS}},\
+        {0x6D, {TokenType::REGISTER, TokenType::NUMBER}, 0x96, 0xB6},\
+        {0x6E, {TokenType::REGISTER, TokenType::ADDRESS}, 0x97, 0xB7},\
         {0x6F, {}} }},\
     { "POW", {\
         {0x6C, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x6D, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x6E, {TokenType::REGISTER, TokenType::ADDRESS}},\
+        {0x6D, {TokenType::REGISTER, TokenType::NUMBER}, 0x98, 0xB8},\
+        {0x6E, {TokenType::REGISTER, TokenType::ADDRESS}, 0x99, 0xB9},\
         {0x6F, {}} }},\
     { "MOD", {\
         {0x6C, {TokenType::REGISTER, TokenType::REGISTER}},\
-        {0x6D, {TokenType::REGISTER, TokenType::LITERAL}},\
-        {0x6E, {TokenType::REGISTER, TokenType::ADDRESS}},\
+        {0x6D, {TokenType::REGISTER, TokenType::NUMBER}, 0x9A, 0xBA},\
+        {0x6E, {TokenType::REGISTER, TokenType::ADDRESS}, 0x9B, 0xBB},\
         {0x6F, {}} }},\
     { "FRS", {\
         {0xF0, {}} }},\
@@ -106,27 +132,27 @@
         {0xFF, {}} }},\
 }
 
+// opcodes the original instruction set gives to more than one encoding, PSH of a number and of an address and the
+// MUL, POW and MOD family. they are kept for compatibility, every other opcode has to name a single encoding
+#define CCVM_SHARED_OPCODES { 0x17, 0x6C, 0x6D, 0x6E, 0x6F }
+
+// short forms of the branches, they take a signed 8 or 16 bit displacement relative to the end of the instruction
+// instead of an absolute address
+#define CCVM_SHORT_BRANCHES {\
+    { "JMP", 0x40, 0x48 },\
+    { "JNE", 0x41, 0x49 },\
+    { "JEQ", 0x42, 0x4A },\
+    { "JLT", 0x43, 0x4B },\
+    { "JGT", 0x44, 0x4C },\
+    { "JOF", 0x45, 0x4D },\
+    { "CALL", 0x46, 0x4E },\
+}
+
 // how to compile:
-// g++ main.cpp -o cca -std=c++11 && ./cca test.cca
+// g++ main.cpp -o cca -std=c++17 && ./cca test.cca
 
 namespace CCA {
-    std::string replace(std::string str, const std::string &sub1, const std::string &sub2) {
-        if (sub1.empty())
-            return str;
-
-        std::size_t pos;
-
-        while ((pos = str.find(sub1)) != std::string::npos)
-            str.replace(pos, sub1.size(), sub2);
-
-        return str;
-    }
-
-    bool in_array(const std::string &value, const std::vector<std::string> &array) {
-        return std::find(array.begin(), array.end(), value) != array.end();
-    }
-
-    enum class TokenType {
+    enum class TokenType : unsigned char {
         IDENTIFIER,
         NUMBER,
         DIVIDER,
@@ -136,729 +162,3989 @@ namespace CCA {
         END,
         ADDRESS,
         STRING,
+        LABEL, // reference to a marker, its value is an instruction index until the layout pass turns it into an address
+        DIRECTIVE, // %name, only seen by the include expansion which removes them
         UNKNOWN
     };
 
+    // valString points into the source buffer, so tokens must not outlive it. identifiers and markers are the
+    // exception, their valString is owned by the SymbolPool and valNumeric holds their symbol id. this is how the
+    // lexer hands tokens out, a whole file of them is kept in a TokenStore
     struct Token {
         TokenType type;
         int lineFound;
-        std::string valString;
-        int valNumeric;
-        int byteIndex;
+        std::string_view valString;
+        uint32_t valNumeric;
     };
 
+    // names are ids into the SymbolPool of the assembly
     struct Definition {
         int index;
-        std::string value;
-        std::string name;
+        std::string_view value;
+        uint32_t name;
+        int lineFound;
+        bool stored = true; // false when the value lives inside the storage of another definition
+        size_t token = 0;   // the instruction token that followed it, which orders it among the markers
     };
 
     struct Marker {
-        std::string name;
+        uint32_t name;
+        unsigned int instruction; // index of the instruction the marker is in front of
         int byteIndex;
+        int lineFound;
     };
 
-    struct Instruction {
-        unsigned char opcode;
-        std::vector<TokenType> args;
+    // compile time copy of CCVM_INSTRUCTION_SET, everything that needs to know about mnemonics is derived from it
+    struct EncodingSpec {
+        unsigned char opcode = 0;
+        TokenType args[2] = {};
+        unsigned char argCount = 0;
+        bool narrow = false;
+        unsigned char imm8 = 0;
+        unsigned char imm16 = 0;
+
+        constexpr EncodingSpec() {}
+
+        constexpr EncodingSpec(unsigned char _opcode, std::initializer_list<TokenType> _args) : opcode(_opcode) {
+            if (_args.size() > 2)
+                throw "instructions take at most two arguments";
+
+            for (TokenType arg: _args)
+                args[argCount++] = arg;
+        }
+
+        constexpr EncodingSpec(unsigned char _opcode, std::initializer_list<TokenType> _args, unsigned char _imm8,
+                               unsigned char _imm16) : EncodingSpec(_opcode, _args) {
+            narrow = true;
+            imm8 = _imm8;
+            imm16 = _imm16;
+        }
     };
 
-    std::string readFile(std::string &fileName) {
-        std::ifstream file(fileName);
-        std::string content;
+    struct MnemonicSpec {
+        const char *name = "";
+        EncodingSpec encodings[8] = {};
+        unsigned char encodingCount = 0;
 
-        if (!file.is_open()) {
-            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not open file '" << fileName
-                      << "', are you sure it exists?\n\n";
-            std::exit(-1);
+        constexpr MnemonicSpec(const char *_name, std::initializer_list<EncodingSpec> _encodings) : name(_name) {
+            if (_encodings.size() > 8)
+                throw "too many encodings for a single mnemonic";
+
+            for (const EncodingSpec &encoding: _encodings)
+                encodings[encodingCount++] = encoding;
         }
+    };
 
-        file.seekg(0, std::ios::end);
-        content.reserve(file.tellg());
-        file.seekg(0, std::ios::beg);
+    constexpr MnemonicSpec mnemonics[] = CCVM_INSTRUCTION_SET;
+    constexpr const char *registerNames[] = CCVM_REGISTERS;
 
-        content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    constexpr unsigned int MNEMONIC_COUNT = sizeof(mnemonics) / sizeof(mnemonics[0]);
+    constexpr unsigned int REGISTER_COUNT = sizeof(registerNames) / sizeof(registerNames[0]);
 
-        file.close();
-        return content;
+    // the operand types of an instruction are packed into a signature key, 2 bits per operand where 0 means there
+    // is no operand, so picking an encoding is a single lookup in a table indexed by mnemonic and signature
+    constexpr unsigned int OPERAND_BITS = 2;
+    constexpr unsigned int MAX_OPERANDS = 2;
+    constexpr unsigned int SIGNATURE_COUNT = 1 << (OPERAND_BITS * MAX_OPERANDS);
+
+    constexpr unsigned int operandCode(TokenType type) {
+        switch (type) {
+            case TokenType::REGISTER:
+                return 1;
+            case TokenType::NUMBER:
+                return 2;
+            case TokenType::ADDRESS:
+            case TokenType::LABEL:
+                return 3;
+            default:
+                return 0;
+        }
     }
 
-    bool isRegisterOrInstruction(std::string code) {
-        std::vector<std::string> opcodes = CCVM_OPCODES;
-        std::vector<std::string> registers = CCVM_REGISTERS;
+    // computes the signature key of the given operand types, returns false when no instruction could take them
+    constexpr bool signatureKey(const TokenType *types, size_t count, unsigned int &key) {
+        if (count > MAX_OPERANDS)
+            return false;
 
-        // indentify the opcodes
-        if (in_array(code, opcodes) || in_array(code, registers))
-            return true;
-        return false;
-    }
+        key = 0;
 
-    bool isIgnorable(char c) {
-        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
-    }
+        for (size_t i = 0; i < count; i++) {
+            unsigned int code = operandCode(types[i]);
 
-    bool isNumber(char c) {
-        return c <= '9' && c >= '0';
-    }
+            if (code == 0)
+                return false;
 
-    bool isDivider(char c) {
-        return c == ',';
-    }
+            key |= code << (OPERAND_BITS * i);
+        }
 
-    bool isIdentifier(char c) {
-        return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || c == '_';
+        return true;
     }
 
-    bool isAddress(char c) {
-        return c == '&';
-    }
+    struct Encoding {
+        bool valid = false;
+        unsigned char opcode = 0;
+        bool narrow = false; // whether imm8 and imm16 exist
+        unsigned char imm8 = 0;
+        unsigned char imm16 = 0;
+    };
 
-    bool isComment(char c) {
-        return c == ';';
-    }
+    struct EncoderTable {
+        Encoding encodings[MNEMONIC_COUNT][SIGNATURE_COUNT] = {};
+    };
 
-    bool isString(char c) {
-        return c == '\'' || c == '"';
-    }
+    constexpr EncoderTable buildEncoderTable() {
+        EncoderTable table;
+
+        for (unsigned int m = 0; m < MNEMONIC_COUNT; m++) {
+            for (unsigned int e = 0; e < mnemonics[m].encodingCount; e++) {
+                const EncodingSpec &spec = mnemonics[m].encodings[e];
+                unsigned int key = 0;
+
+                if (!signatureKey(spec.args, spec.argCount, key))
+                    throw "instruction set uses an operand type that can't be encoded";
+
+                // the first encoding listed for a signature wins
+                if (!table.encodings[m][key].valid)
+                    table.encodings[m][key] = Encoding{true, spec.opcode, spec.narrow, spec.imm8, spec.imm16};
+            }
+        }
 
-    bool isMarker(char c) {
-        return c == ':';
+        return table;
     }
 
-    std::string parseWord(std::string &code, unsigned int &readingIndex) {
-        std::string result = "";
+    constexpr EncoderTable encoder = buildEncoderTable();
 
-        while (isIdentifier(code[readingIndex]))
-            result += code[readingIndex++];
+    // returns the encoding of the mnemonic taking the given operand types, it is invalid when there is none
+    Encoding findEncoding(unsigned int mnemonic, const TokenType *types, size_t count) {
+        unsigned int key = 0;
 
-        --readingIndex;
+        if (!signatureKey(types, count, key))
+            return Encoding{};
 
-        return result;
+        return encoder.encodings[mnemonic][key];
     }
 
-    std::string parseString(std::string &code, unsigned int &readingIndex) {
-        std::string result = "";
+    struct BranchSpec {
+        const char *name;
+        unsigned char rel8;
+        unsigned char rel16;
+    };
 
-        while (!isString(code[readingIndex]))
-            result += code[readingIndex++];
+    constexpr BranchSpec branchSpecs[] = CCVM_SHORT_BRANCHES;
 
-        return result;
-    }
+    struct ShortBranch {
+        bool valid = false;
+        unsigned char rel8 = 0;
+        unsigned char rel16 = 0;
+    };
 
-    int parseNumber(std::string &code, unsigned int &readingIndex) {
-        std::string result = "";
+    struct ShortBranchTable {
+        ShortBranch branches[MNEMONIC_COUNT] = {};
+    };
 
-        int index = 0;
-        int base = 10;
+    constexpr ShortBranchTable buildShortBranchTable() {
+        ShortBranchTable table;
 
-        while (isNumber(code[readingIndex])) {
-            if (index == 0 && code[readingIndex] == '0' && code[readingIndex + 1] == 'x') {
-                base = 16;
-                readingIndex += 2;
-            } else if (index == 0 && code[readingIndex] == '0' && code[readingIndex + 1] == 'b') {
-                base = 2;
-                readingIndex += 2;
-            } else if (index == 0 && code[readingIndex] == '0' && code[readingIndex + 1] == 'o') {
-                base = 8;
-                readingIndex += 2;
-            }
+        for (const BranchSpec &spec: branchSpecs) {
+            unsigned int m = 0;
 
-            result += code[readingIndex++];
-            ++index;
-        }
+            while (m < MNEMONIC_COUNT && std::string_view(mnemonics[m].name) != spec.name)
+                ++m;
 
-        --readingIndex;
+            if (m == MNEMONIC_COUNT)
+                throw "short branch for a mnemonic that is not in the instruction set";
 
-        // handle non base10 bases
-        if (base == 2) {
-            return std::stoi(result, 0, 2);
-        } else if (base == 8) {
-            return std::stoi(result, 0, 8);
-        } else if (base == 16) {
-            return std::stoi(result, 0, 16);
+            table.branches[m] = ShortBranch{true, spec.rel8, spec.rel16};
         }
 
-        return std::stoi(result);
+        return table;
     }
 
-    std::vector<Token> lexer(std::string code) {
-        std::vector<Token> tokens;
-        int lineFound = 1;
-        bool error = false;
-        bool foundDef = false;
-        int byteIndex = 0;
+    // short branch forms indexed by mnemonic
+    constexpr ShortBranchTable shortBranches = buildShortBranchTable();
 
-        for (unsigned int readingIndex = 0; readingIndex < code.size(); readingIndex++) {
-            char currentCharacter = code[readingIndex];
+    constexpr unsigned char sharedOpcodes[] = CCVM_SHARED_OPCODES;
 
-            if (currentCharacter == '\n') {
-                lineFound++;
-            }
+    // whether the vm can tell from the opcode byte alone which mnemonic and operand types it stands for. every byte
+    // the encoder or the short branches can write has to belong to a single mnemonic and signature, only the wide
+    // opcodes listed in CCVM_SHARED_OPCODES may be used by several
+    constexpr bool opcodesAreDistinct() {
+        unsigned int owners[256] = {}; // mnemonic * SIGNATURE_COUNT + signature + 1, 0 while the byte is unused
+        bool conflict[256] = {};
+        bool narrow[256] = {};
+        bool shared[256] = {};
 
-            if (isIgnorable(currentCharacter)) {
-                continue;
-            } else if (isMarker(currentCharacter)) {
-                ++readingIndex;
-                std::string value = parseWord(code, readingIndex);
-
-                tokens.push_back(Token{
-                        TokenType::MARKER,
-                        lineFound,
-                        value,
-                        0,
-                        byteIndex
-                });
-            } else if (isDivider(currentCharacter)) {
-                tokens.push_back(Token{
-                        TokenType::DIVIDER,
-                        lineFound,
-                        ",",
-                        0,
-                        byteIndex
-                });
-            } else if (isIdentifier(currentCharacter)) {
-                std::string value = parseWord(code, readingIndex);
+        for (unsigned char opcode: sharedOpcodes)
+            shared[opcode] = true;
 
-                tokens.push_back(Token{
-                        TokenType::IDENTIFIER,
-                        lineFound,
-                        value,
-                        0,
-                        byteIndex
-                });
+        auto claim = [&](unsigned char opcode, unsigned int owner, bool isNarrow) {
+            narrow[opcode] |= isNarrow;
 
-                ++byteIndex;
-
-                if (foundDef) {
-                    foundDef = false;
-                    --byteIndex;
-                } else if (value == "def") {
-                    foundDef = true;
-                    --byteIndex;
-                } else if (!isRegisterOrInstruction(value)) {
-                    byteIndex += 3;
-                }
-            } else if (isNumber(currentCharacter)) {
-                int value = parseNumber(code, readingIndex);
-
-                tokens.push_back(Token{
-                        TokenType::NUMBER,
-                        lineFound,
-                        "",
-                        value,
-                        byteIndex
-                });
+            if (owners[opcode] == 0)
+                owners[opcode] = owner;
+            else if (owners[opcode] != owner)
+                conflict[opcode] = true;
+        };
 
-                byteIndex += 4;
-            } else if (isAddress(currentCharacter)) {
-                ++readingIndex;
-                int value = parseNumber(code, readingIndex);
-
-                tokens.push_back(Token{
-                        TokenType::ADDRESS,
-                        lineFound,
-                        "",
-                        value,
-                        byteIndex
-                });
+        for (unsigned int m = 0; m < MNEMONIC_COUNT; m++) {
+            for (unsigned int key = 0; key < SIGNATURE_COUNT; key++) {
+                const Encoding &encoding = encoder.encodings[m][key];
+                unsigned int owner = m * SIGNATURE_COUNT + key + 1;
 
-                byteIndex += 4;
-            } else if (isString(currentCharacter)) {
-                ++readingIndex;
-                std::string value = parseString(code, readingIndex);
+                if (!encoding.valid)
+                    continue;
 
-                tokens.push_back(Token{
-                        TokenType::STRING,
-                        lineFound,
-                        value,
-                        0,
-                        byteIndex
-                });
-            } else if (isComment(currentCharacter)) {
-                ++readingIndex;
-                ++lineFound;
+                claim(encoding.opcode, owner, false);
 
-                while (readingIndex <= code.size() && code[readingIndex] != '\n') {
-                    ++readingIndex;
+                if (encoding.narrow) {
+                    claim(encoding.imm8, owner, true);
+                    claim(encoding.imm16, owner, true);
                 }
-            } else {
-                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Unexpected symbol on"
-                          << termcolor::red << " line " << lineFound << termcolor::reset;
-                error = true;
             }
-        }
 
-        if (error) {
-            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Aborting due to errors while parsing\n";
-            std::exit(-1);
-        }
+            // the short forms stand for a branch to a marker, which has the signature of an address
+            if (shortBranches.branches[m].valid) {
+                unsigned int owner = m * SIGNATURE_COUNT + operandCode(TokenType::LABEL) + 1;
 
-        return tokens;
-    }
+                claim(shortBranches.branches[m].rel8, owner, true);
+                claim(shortBranches.branches[m].rel16, owner, true);
+            }
+        }
 
-    std::string stringifyToken(TokenType value) {
-        switch (value) {
-            case TokenType::IDENTIFIER:
-                return "identifier";
-            case TokenType::NUMBER:
-                return "number";
-            case TokenType::DIVIDER:
-                return "divider";
-            case TokenType::OPCODE:
-                return "opcode";
-            case TokenType::REGISTER:
-                return "register";
-            case TokenType::MARKER:
-                return "marker";
-            case TokenType::END:
-                return "end";
-            case TokenType::ADDRESS:
-                return "address";
-            case TokenType::STRING:
-                return "string";
-            default:
-                return "unknown";
+        for (unsigned int opcode = 0; opcode < 256; opcode++) {
+            if (conflict[opcode] && (narrow[opcode] || !shared[opcode]))
+                return false;
         }
-    }
 
-    std::string stringifyTokenValue(Token t) {
-        if (t.type == TokenType::ADDRESS || t.type == TokenType::NUMBER)
-            return std::to_string(t.valNumeric);
-        else
-            return t.valString;
+        return true;
     }
 
-    void printTokens(std::vector<Token> &tokens) {
-        int lineNumberMagnitude = std::floor(std::log10(tokens.back().lineFound));
-        int currentLineNumber = 0;
+    static_assert(opcodesAreDistinct(), "an opcode is used by two encodings, the vm could not tell them apart");
 
-        for (auto &t: tokens) {
-            int currentMagnitude = lineNumberMagnitude - std::floor(std::log10(t.lineFound));
-            int tokenTypePadding = 8 - stringifyToken(t.type).size();
+    enum class KeywordKind : unsigned char {
+        NONE,
+        OPCODE,
+        REGISTER
+    };
 
-            if (t.lineFound != currentLineNumber) {
-                std::cout << "  " << t.lineFound;
-                currentLineNumber = t.lineFound;
-            } else {
-                std::cout << "  .";
-            }
+    struct Keyword {
+        std::string_view name;
+        KeywordKind kind = KeywordKind::NONE;
+        unsigned char index = 0; // into mnemonics or registerNames
+    };
 
-            for (int i = 0; i < currentMagnitude; i++) {
-                std::cout << " ";
-            }
+    // perfect hash over every mnemonic and register name, case insensitive. the seed is searched for at compile
+    // time so that no two keywords share a slot, which makes a lookup one hash and one compare
+    constexpr unsigned int KEYWORD_SLOTS = 128;
 
-            if (t.type == TokenType::ADDRESS || t.type == TokenType::NUMBER) {
-                std::cout
-                        << termcolor::blue << " | "
-                        << termcolor::reset << stringifyToken(t.type)
-                        << termcolor::blue << ": " << termcolor::reset;
+    struct KeywordTable {
+        Keyword slots[KEYWORD_SLOTS] = {};
+        unsigned int seed = 0;
+        unsigned int longest = 0;
+    };
 
-                for (int i = 0; i < tokenTypePadding; i++)
-                    std::cout << " ";
+    constexpr char toLower(char c) {
+        return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+    }
 
-                std::cout << t.valNumeric << "\n";
-            } else {
-                std::cout
-                        << termcolor::blue << " | "
-                        << termcolor::reset << stringifyToken(t.type) << termcolor::blue << ": " << termcolor::reset;
+    constexpr unsigned int keywordHash(std::string_view word, unsigned int seed) {
+        unsigned int hash = 2166136261u ^ seed;
 
-                for (int i = 0; i < tokenTypePadding; i++)
-                    std::cout << " ";
+        for (char c: word)
+            hash = (hash ^ static_cast<unsigned char>(toLower(c))) * 16777619u;
 
-                std::cout << t.valString << "\n";
-            }
-        }
+        return (hash ^ (hash >> 15)) % KEYWORD_SLOTS;
     }
 
-    void printDefs(std::vector<Definition> &defs) {
-        int longestDefName = 0;
-        int longestDefAddr = 0;
-
-        // find the longest def name length
-        for (auto &d: defs) {
-            int defNameLength = d.name.size();
-            int defAddrLength;
-
-            if (d.index == 0) {
-                defAddrLength = 1;
-            } else {
-                defAddrLength = longestDefAddr - std::floor(std::log10(d.index));
-            }
+    constexpr bool insertKeyword(KeywordTable &table, std::string_view name, KeywordKind kind, unsigned char index) {
+        Keyword &slot = table.slots[keywordHash(name, table.seed)];
 
-            if (defNameLength > longestDefName)
-                longestDefName = defNameLength;
+        if (slot.kind != KeywordKind::NONE)
+            return false;
 
-            if (defAddrLength > longestDefAddr)
-                longestDefAddr = defAddrLength;
-        }
+        slot = Keyword{name, kind, index};
 
-        for (auto &d: defs) {
-            int namePaddingAmount = longestDefName - d.name.size();
-            int addrPaddingAmount = 0;
+        if (name.size() > table.longest)
+            table.longest = name.size();
 
-            if (d.index == 0) {
-                addrPaddingAmount = 1;
-            } else {
-                addrPaddingAmount = longestDefAddr - std::floor(std::log10(d.index));
-            }
+        return true;
+    }
 
-            std::cout << termcolor::blue << "  name: " << termcolor::reset << d.name << ", ";
+    constexpr KeywordTable buildKeywordTable() {
+        for (unsigned int seed = 0; seed < 100000; seed++) {
+            KeywordTable table;
+            table.seed = seed;
 
-            for (int i = 0; i < namePaddingAmount; i++)
-                std::cout << " ";
+            bool collision = false;
 
-            std::cout << termcolor::blue << "addr: " << termcolor::reset << d.index << ", ";
+            for (unsigned int i = 0; i < MNEMONIC_COUNT && !collision; i++)
+                collision = !insertKeyword(table, mnemonics[i].name, KeywordKind::OPCODE, i);
 
-            for (int i = 0; i < addrPaddingAmount; i++)
-                std::cout << " ";
+            for (unsigned int i = 0; i < REGISTER_COUNT && !collision; i++)
+                collision = !insertKeyword(table, registerNames[i], KeywordKind::REGISTER, i);
 
-            std::cout << termcolor::blue << "str: " << termcolor::reset << "'" << d.value << "'"
-                      << termcolor::blue << "\n" << termcolor::reset;
+            if (!collision)
+                return table;
         }
-    }
 
-    void printMarkers(std::vector<Marker> &markers) {
-        int longestMarkerName = 0;
+        throw "no perfect hash seed found, increase KEYWORD_SLOTS";
+    }
 
-        for (auto &m: markers) {
-            int currentMarkerLength = m.name.size();
+    constexpr KeywordTable keywords = buildKeywordTable();
 
-            if (currentMarkerLength > longestMarkerName) {
-                longestMarkerName = currentMarkerLength;
-            }
-        }
+    // returns the mnemonic or register word names, or an empty keyword when it is neither
+    Keyword findKeyword(std::string_view word) {
+        if (word.size() > keywords.longest)
+            return Keyword{};
 
-        for (auto &m: markers) {
-            int markerNamePadding = longestMarkerName - m.name.size();
-            std::cout << termcolor::blue << "  name: " << termcolor::reset << m.name << ", ";
+        const Keyword &slot = keywords.slots[keywordHash(word, keywords.seed)];
 
-            for (int i = 0; i < markerNamePadding; i++)
-                std::cout << " ";
+        if (slot.name.size() != word.size())
+            return Keyword{};
 
-            std::cout << termcolor::blue << "addr: " << termcolor::reset << m.byteIndex
-                      << termcolor::yellow << "\n" << termcolor::reset;
+        for (unsigned int i = 0; i < word.size(); i++) {
+            if (toLower(word[i]) != toLower(slot.name[i]))
+                return Keyword{};
         }
+
+        return slot;
     }
 
-    std::vector<Definition> parseDefinitions(std::vector<Token> &tokens) {
-        std::vector<Token> tempTokens;
-        int definitionMemoryIndex = 0;
-        std::vector<Definition> definitions;
+    // rewrites an identifier that names a mnemonic or register into an OPCODE or REGISTER token. valString is
+    // swapped for the canonical spelling, which is static, and valNumeric holds the mnemonic or register index
+    bool classifyKeyword(Token &t) {
+        Keyword keyword = findKeyword(t.valString);
 
-        for (unsigned int i = 0; i < tokens.size(); i++) {
-            Token t = tokens[i];
+        if (keyword.kind == KeywordKind::NONE)
+            return false;
 
-            if (t.type == TokenType::IDENTIFIER && t.valString == "def") {
-                if (tokens[i + 1].type != TokenType::IDENTIFIER || tokens[i + 2].type != TokenType::STRING) {
-                    std::cout << termcolor::red << "[ERROR]" << termcolor::reset
-                              << " Unknown syntax in definition statement on " << termcolor::red << " line "
-                              << t.lineFound << termcolor::reset;
-                    std::exit(-1);
-                }
+        t.type = keyword.kind == KeywordKind::OPCODE ? TokenType::OPCODE : TokenType::REGISTER;
+        t.valString = keyword.name;
+        t.valNumeric = keyword.index;
 
-                definitions.push_back(Definition{
-                        definitionMemoryIndex,
-                        tokens[i + 2].valString,
-                        tokens[i + 1].valString
-                });
+        return true;
+    }
 
-                definitionMemoryIndex += tokens[i + 2].valString.size();
+    // read-only view of a source file, the file is memory mapped where the platform supports it
+    // so that the lexer can hand out tokens that point straight into it
+    class SourceFile {
+    private:
+        const char *data = nullptr;
+        size_t size = 0;
+        bool mapped = false;
+        std::string content;
 
-                i += 2;
-                continue;
-            } else {
-                tempTokens.push_back(t);
-            }
-        }
+        void readFallback(std::ifstream &file) {
+            file.seekg(0, std::ios::end);
+            content.reserve(file.tellg());
+            file.seekg(0, std::ios::beg);
 
-        tokens = tempTokens;
+            content.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
 
-        return definitions;
-    }
+            data = content.data();
+            size = content.size();
+        }
 
-    void postTokenizer(std::vector<Token> &tokens, std::vector<Marker> &markers, std::vector<Definition> &definitions) {
-        std::vector<Token> partialCopy = {};
+    public:
+        SourceFile(const std::string &fileName) {
+#ifndef _WIN32
+            int fd = open(fileName.c_str(), O_RDONLY);
+            struct stat info;
 
-        for (unsigned int i = 0; i < tokens.size(); i++) {
-            Token &t = tokens[i];
+            if (fd != -1 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+                size = info.st_size;
 
-            std::vector<std::string> opcodes = CCVM_OPCODES;
-            std::vector<std::string> registers = CCVM_REGISTERS;
+                if (size > 0) {
+                    void *address = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
 
-            // identify the opcodes
-            if (t.type == TokenType::IDENTIFIER && in_array(t.valString, opcodes))
-                t.type = TokenType::OPCODE;
+                    if (address != MAP_FAILED) {
+                        madvise(address, size, MADV_SEQUENTIAL);
+                        data = static_cast<const char *>(address);
+                        mapped = true;
+                    }
+                }
 
-            // identify the registers
-            if (t.type == TokenType::IDENTIFIER && in_array(t.valString, registers))
-                t.type = TokenType::REGISTER;
+                if (size == 0 || mapped) {
+                    close(fd);
+                    return;
+                }
+            }
 
-            // markers
-            if (t.type == TokenType::MARKER) {
-                markers.push_back(Marker{
-                        t.valString,
-                        t.byteIndex
-                });
+            if (fd != -1)
+                close(fd);
+#endif
+            std::ifstream file(fileName, std::ios::binary);
 
-            } else {
-                partialCopy.push_back(t);
+            if (!file.is_open()) {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not open file '" << fileName
+                          << "', are you sure it exists?\n\n";
+                std::exit(-1);
             }
+
+            readFallback(file);
         }
 
-        bool errors = false;
+        ~SourceFile() {
+#ifndef _WIN32
+            if (mapped)
+                munmap(const_cast<char *>(data), size);
+#endif
+        }
 
-        tokens = partialCopy;
+        SourceFile(const SourceFile &) = delete;
+        SourceFile &operator=(const SourceFile &) = delete;
 
-        for (unsigned int i = 0; i < tokens.size(); i++) {
-            Token &t = tokens[i];
-            if (t.type == TokenType::IDENTIFIER) {
-                t.type = TokenType::NUMBER;
+        std::string_view view() const {
+            return std::string_view(data, size);
+        }
+    };
 
-                bool found = false;
+    // value of the 8 decimal digits at p, computed with a few multiplies on the whole word instead of per digit
+    uint32_t parseEightDigits(const char *p) {
+        uint64_t chunk;
+        std::memcpy(&chunk, p, 8);
 
-                for (unsigned int j = 0; j < markers.size(); j++) {
-                    Marker &m = markers[j];
+        chunk = (chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561 >> 8;
+        chunk = (chunk & 0x00FF00FF00FF00FFULL) * 6553601 >> 16;
 
-                    if (m.name == t.valString) {
-                        t.valNumeric = m.byteIndex;
-                        found = true;
-                        break;
-                    }
-                }
+        return static_cast<uint32_t>((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL >> 32);
+    }
 
-                if (!found) { // HERE
-                    for (unsigned int j = 0; j < definitions.size(); j++) {
-                        Definition &d = definitions[j];
+    // parses the digits of an integer literal that the lexer already validated for the given base, without
+    // allocating. returns false when the value does not fit in 32 unsigned bits
+    bool parseInteger(std::string_view digits, unsigned int base, uint32_t &value) {
+        const uint64_t LIMIT = 0xFFFFFFFFULL;
+        const char *p = digits.data();
+        const char *end = p + digits.size();
+        uint64_t result = 0;
+
+        if (base == 10) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+            for (; end - p >= 8; p += 8) {
+                result = result * 100000000 + parseEightDigits(p);
+
+                if (result > LIMIT)
+                    return false;
+            }
+#endif
+            for (; p < end; ++p) {
+                result = result * 10 + (*p - '0');
 
-                        if (d.name == t.valString) {
-                            t.valNumeric = d.index;
-                            found = true;
-                            break;
-                        }
-                    }
-                }
+                if (result > LIMIT)
+                    return false;
+            }
+        } else {
+            unsigned int shift = base == 16 ? 4 : base == 8 ? 3 : 1;
 
-                if (!found) {
-                    std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not match identifier '"
-                              << t.valString << "' on" << termcolor::red << " line " << t.lineFound << termcolor::reset
-                              << "\n\n";
-                    errors = true;
-                }
+            for (; p < end; ++p) {
+                unsigned int digit = *p <= '9' ? *p - '0' : (*p | 0x20) - 'a' + 10;
+                result = result << shift | digit;
 
-                tokens[i] = t;
+                if (result > LIMIT)
+                    return false;
             }
         }
 
-        if (errors) {
-            std::cout << termcolor::red << "[ERROR]" << termcolor::reset
-                      << " Aborting due to errors while analyzing semantics\n\n";
-            std::exit(-1);
-        }
+        value = static_cast<uint32_t>(result);
+        return true;
+    }
 
+    int hexDigit(char c) {
+        if (c >= '0' && c <= '9')
+            return c - '0';
 
-    }
+        if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+            return (c | 0x20) - 'a' + 10;
 
-    void pushRegister(std::vector<unsigned char> &bytecode, const Token &t) {
-        bytecode.push_back(t.valString[0] - 'a');
+        return -1;
     }
 
-    void pushNumeric(std::vector<unsigned char> &bytecode, const Token &t) {
-        for (int i = 0; i < 4; i++) {
-            unsigned char byte = (t.valNumeric >> (24 - 8 * i)) & 0xFF;
-            bytecode.push_back(byte);
+    // the character a single letter escape stands for, 0 when it isn't one
+    char escapeCharacter(char c) {
+        switch (c) {
+            case 'n':
+                return '\n';
+            case 't':
+                return '\t';
+            case '\\':
+                return '\\';
+            case '\'':
+                return '\'';
+            case '"':
+                return '"';
+            case 'a':
+                return '\a';
+            case 'b':
+                return '\b';
+            case 'e':
+                return '\x1B';
+            case 'f':
+                return '\f';
+            case 'r':
+                return '\r';
+            case 'v':
+                return '\v';
+            default:
+                return 0;
         }
     }
 
-    void pushLabel(std::vector<unsigned char> &bytecode, const Token &t) {
-        for (int i = 0; i < 4; i++) {
-            unsigned char byte = (t.byteIndex >> (24 - 8 * i)) & 0xFF;
-            bytecode.push_back(byte);
-        }
-    }
+    // decodes the escapes of a string body in a single pass, destination needs room for raw.size() bytes since
+    // decoding never makes a string longer. \x takes one or two hex digits, unknown escapes are kept as they are.
+    // returns the decoded size
+    size_t decodeEscapes(std::string_view raw, char *destination) {
+        char *out = destination;
 
-    std::map<std::string, std::vector<Instruction>> instructionSet = CCVM_INSTRUCTION_SET;
+        for (size_t i = 0; i < raw.size(); i++) {
+            if (raw[i] != '\\' || i + 1 == raw.size()) {
+                *out++ = raw[i];
+                continue;
+            }
 
-    void generateBytecode(std::vector<Definition> definitions, std::vector<Token> tokens, std::string fileName) {
-        std::vector<unsigned char> bytecode;
+            char escaped = escapeCharacter(raw[i + 1]);
 
-        bool error = false;
+            if (escaped) {
+                *out++ = escaped;
+                ++i;
+            } else if (raw[i + 1] == 'x' && i + 2 < raw.size() && hexDigit(raw[i + 2]) >= 0) {
+                int value = hexDigit(raw[i + 2]);
+                i += 2;
 
-        for (unsigned int i = 0; i < tokens.size(); i++) {
-            const Token &opcode = tokens[i];
+                if (i + 1 < raw.size() && hexDigit(raw[i + 1]) >= 0)
+                    value = value * 16 + hexDigit(raw[++i]);
 
-            // if not opcode, something must've gone wrong, error
-            if (opcode.type != TokenType::OPCODE) {
-                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Expected opcode on line "
-                          << opcode.lineFound << " got " << stringifyToken(opcode.type) << ": "
-                          << stringifyTokenValue(opcode) << "\n";
-                std::exit(-1);
+                *out++ = static_cast<char>(value);
+            } else {
+                *out++ = raw[i];
             }
+        }
 
-            // find the instructions that this opcode could be part of
-            std::vector<Instruction> possibleInstructions = instructionSet[opcode.valString];
+        return out - destination;
+    }
 
-            // gather the arguments given to this opcode, also keep in mind there could be no more arguments
-            std::vector<Token> arguments = {};
-            while (i < (tokens.size() - 1) && tokens[i + 1].type != TokenType::OPCODE)
-                arguments.push_back(tokens[++i]);
+    // the opposite of decodeEscapes for showing strings in debug output
+    std::string escapeString(std::string_view value) {
+        static const char *digits = "0123456789ABCDEF";
+        std::string escaped;
+
+        for (char c: value) {
+            unsigned char byte = c;
+
+            if (c == '\n') {
+                escaped += "\\n";
+            } else if (c == '\t') {
+                escaped += "\\t";
+            } else if (c == '\\') {
+                escaped += "\\\\";
+            } else if (byte < 0x20 || byte >= 0x7F) {
+                escaped += "\\x";
+                escaped += digits[byte >> 4];
+                escaped += digits[byte & 0xF];
+            } else {
+                escaped += c;
+            }
+        }
 
-            Instruction matchingInstruction;
+        return escaped;
+    }
 
-            // find the instruction fitting with this opcode and arguments
-            for (int j = 0; j < possibleInstructions.size(); j++) {
-                // check every instruction
-                Instruction instr = possibleInstructions[j];
+    // bump pointer allocator for whatever lives as long as an assembly. memory is handed out from large blocks
+    // that never move, so pointers into it stay valid until reset, which rewinds to the first block in O(1) and
+    // keeps every block for the next assembly
+    class Arena {
+    private:
+        static constexpr size_t BLOCK_SIZE = 1 << 16;
 
-                // they must be the same in size
-                if (arguments.size() != instr.args.size())
-                    continue;
+        struct Block {
+            std::unique_ptr<char[]> data;
+            size_t capacity;
+        };
 
-                bool matching = true;
+        std::vector<Block> blocks;
+        size_t current = 0; // the block allocations come from, the ones after it are free
+        size_t used = 0;    // bytes handed out from the current block
 
-                // they must be the matching in content
-                for (int k = 0; k < instr.args.size(); k++) {
-                    if (arguments[k].type != instr.args[k]) {
-                        matching = false;
-                        break;
-                    }
-                }
+    public:
+        char *allocate(size_t size) {
+            // a block the allocation doesn't fit in is left as it is until the next reset
+            while (current < blocks.size() && size > blocks[current].capacity - used) {
+                ++current;
+                used = 0;
+            }
 
-                // if it was all matching
-                if (matching) {
-                    // this instruction must be the right one!
-                    matchingInstruction = instr;
-                    break;
-                }
+            if (current == blocks.size()) {
+                size_t capacity = std::max(BLOCK_SIZE, size);
+                blocks.push_back(Block{std::unique_ptr<char[]>(new char[capacity]), capacity});
             }
 
-            // add the opcode to the bytecode
-            bytecode.push_back(matchingInstruction.opcode);
+            char *destination = blocks[current].data.get() + used;
+            used += size;
 
-            // translate the arguments to bytecode and add them to the buffer
-            for (int j = 0; j < arguments.size(); j++) {
-                Token arg = arguments[j];
+            return destination;
+        }
 
-                switch (arg.type) {
-                    case TokenType::REGISTER:
-                        pushRegister(bytecode, arg);
-                        break;
-                    case TokenType::ADDRESS:
-                    case TokenType::NUMBER:
-                        pushNumeric(bytecode, arg);
-                }
-            }
+        // gives back the unused end of the last allocation
+        void shrink(size_t unused) {
+            used -= unused;
         }
 
-        if (error) {
+        // takes over the blocks of another arena, what they hold stays valid until this one is reset
+        void adopt(Arena &other) {
+            blocks.insert(blocks.begin() + current, std::make_move_iterator(other.blocks.begin()),
+                          std::make_move_iterator(other.blocks.end()));
+            current += other.blocks.size();
+
+            other.blocks.clear();
+            other.reset();
+        }
+
+        // keeps the blocks that were used so the next assembly doesn't have to allocate them again. blocks left
+        // over behind the ones adopted from other arenas were never touched and are freed, or they would pile up
+        void reset() {
+            if (current + 1 < blocks.size())
+                blocks.resize(current + 1);
+
+            current = 0;
+            used = 0;
+        }
+    };
+
+    // every distinct identifier and marker name of an assembly is stored here exactly once, tokens and the later
+    // stages refer to names by their index in the pool so comparing two names is comparing two integers
+    class SymbolPool {
+    private:
+        // names and decoded strings are packed into the arena, so the views handed out stay valid
+        Arena arena;
+
+        std::vector<std::string_view> names;
+        std::vector<size_t> hashes; // of every name, so growing the index doesn't hash them again
+
+        // open addressing index from name to id. a slot is only in use when it was filled in the current
+        // generation, so clearing the pool empties every slot at once. unlike a node based map it keeps its memory
+        // when the pool is cleared
+        struct Slot {
+            uint32_t id;
+            uint32_t generation;
+        };
+
+        std::vector<Slot> slots;
+        uint32_t generation = 1;
+
+        bool used(size_t slot) const {
+            return slots[slot].generation == generation;
+        }
+
+        void grow() {
+            slots.assign(std::max<size_t>(64, slots.size() * 2), Slot{0, 0});
+
+            for (uint32_t id = 0; id < names.size(); id++) {
+                size_t slot = hashes[id] & (slots.size() - 1);
+
+                while (used(slot))
+                    slot = (slot + 1) & (slots.size() - 1);
+
+                slots[slot] = Slot{id, generation};
+            }
+        }
+
+        // the slot holding name, or the empty slot it would go into
+        size_t slotFor(std::string_view name, size_t hash) const {
+            size_t slot = hash & (slots.size() - 1);
+
+            for (; used(slot); slot = (slot + 1) & (slots.size() - 1)) {
+                uint32_t id = slots[slot].id;
+
+                if (hashes[id] == hash && names[id] == name)
+                    break;
+            }
+
+            return slot;
+        }
+
+    public:
+        // def is interned up front so the definition syntax can be recognized by id
+        static constexpr uint32_t DEF = 0;
+
+        SymbolPool() {
+            intern("def");
+        }
+
+        SymbolPool(const SymbolPool &) = delete;
+        SymbolPool &operator=(const SymbolPool &) = delete;
+
+        uint32_t intern(std::string_view name) {
+            // the index is kept at most half full so probe sequences stay short
+            if ((names.size() + 1) * 2 > slots.size())
+                grow();
+
+            size_t hash = std::hash<std::string_view>{}(name);
+            size_t slot = slotFor(name, hash);
+
+            if (used(slot))
+                return slots[slot].id;
+
+            char *destination = allocate(name.size());
+            std::memcpy(destination, name.data(), name.size());
+
+            slots[slot] = Slot{static_cast<uint32_t>(names.size()), generation};
+            names.emplace_back(destination, name.size());
+            hashes.push_back(hash);
+
+            return names.size() - 1;
+        }
+
+        std::string_view name(uint32_t id) const {
+            return names[id];
+        }
+
+        // looks a name up without interning it, so several threads can do it at once
+        bool find(std::string_view name, uint32_t &id) const {
+            size_t slot = slotFor(name, std::hash<std::string_view>{}(name));
+
+            if (!used(slot))
+                return false;
+
+            id = slots[slot].id;
+            return true;
+        }
+
+        // room for size bytes that lives as long as the pool, the lexer decodes strings into it
+        char *allocate(size_t size) {
+            return arena.allocate(size);
+        }
+
+        // gives back the unused end of the last allocation
+        void shrink(size_t unused) {
+            arena.shrink(unused);
+        }
+
+        // takes over the storage of another pool so that views into it outlive that pool, its names are not
+        // interned here
+        void adopt(SymbolPool &other) {
+            arena.adopt(other.arena);
+        }
+
+        uint32_t size() const {
+            return names.size();
+        }
+
+        // forgets every name but keeps the memory, so the next assembly can reuse it. the slots are emptied by
+        // moving to the next generation, they only have to be written when the generations run out
+        void clear() {
+            arena.reset();
+            names.clear();
+            hashes.clear();
+
+            if (++generation == 0) {
+                std::fill(slots.begin(), slots.end(), Slot{0, 0});
+                generation = 1;
+            }
+
+            intern("def");
+        }
+    };
+
+    // the tokens of a file as columns, so every pass only streams over the ones it needs. a token takes 9 bytes,
+    // only strings and directives have text that isn't known from their value, it is kept in spans and their
+    // value is the index of it
+    struct TokenStore {
+        std::vector<TokenType> types;
+        std::vector<int> lines;
+        std::vector<uint32_t> values; // number, symbol id, mnemonic or register index, or index into spans
+        std::vector<std::string_view> spans;
+
+        size_t size() const {
+            return types.size();
+        }
+
+        bool empty() const {
+            return types.empty();
+        }
+
+        void reserve(size_t count) {
+            types.reserve(count);
+            lines.reserve(count);
+            values.reserve(count);
+        }
+
+        void push(const Token &t) {
+            types.push_back(t.type);
+            lines.push_back(t.lineFound);
+
+            if (t.type == TokenType::STRING || t.type == TokenType::DIRECTIVE) {
+                values.push_back(spans.size());
+                spans.push_back(t.valString);
+            } else {
+                values.push_back(t.valNumeric);
+            }
+        }
+
+        // moves token from to position to, used by the passes that filter tokens out in place
+        void move(size_t from, size_t to) {
+            types[to] = types[from];
+            lines[to] = lines[from];
+            values[to] = values[from];
+        }
+
+        // drops every token from count on, spans are left alone since kept tokens may still point at them
+        void truncate(size_t count) {
+            types.resize(count);
+            lines.resize(count);
+            values.resize(count);
+        }
+
+        void clear() {
+            truncate(0);
+            spans.clear();
+        }
+
+        std::string_view span(size_t i) const {
+            return spans[values[i]];
+        }
+
+        // the token as the lexer handed it out, names are looked up in symbols
+        Token at(size_t i, const SymbolPool &symbols) const {
+            Token t{types[i], lines[i], "", values[i]};
+
+            switch (t.type) {
+                case TokenType::IDENTIFIER:
+                case TokenType::MARKER:
+                    t.valString = symbols.name(t.valNumeric);
+                    break;
+                case TokenType::OPCODE:
+                    t.valString = mnemonics[t.valNumeric].name;
+                    break;
+                case TokenType::REGISTER:
+                    t.valString = registerNames[t.valNumeric];
+                    break;
+                case TokenType::DIVIDER:
+                    t.valString = ",";
+                    break;
+                case TokenType::STRING:
+                case TokenType::DIRECTIVE:
+                    t.valString = spans[t.valNumeric];
+                    t.valNumeric = 0;
+                    break;
+                default:
+                    break;
+            }
+
+            return t;
+        }
+    };
+
+    enum class SymbolKind : unsigned char {
+        NONE,
+        MARKER,
+        DEFINITION
+    };
+
+    // what a name refers to once it has been declared by a marker or a definition
+    struct Symbol {
+        uint32_t name;
+        SymbolKind kind;
+        int address;
+        int lineFound;
+    };
+
+    // open addressing hash table from symbol id to symbol, resolving a reference costs the same no matter how many
+    // symbols the program declares
+    class SymbolTable {
+    private:
+        // a slot is only in use when it was filled in the current generation, like the index of SymbolPool
+        struct Slot {
+            Symbol symbol;
+            uint32_t generation;
+        };
+
+        std::vector<Slot> slots;
+        size_t count = 0;
+        unsigned int shift = 64;
+        uint32_t generation = 1;
+
+        size_t slotFor(uint32_t name) const {
+            // fibonacci hashing, the top bits of the product are well mixed even for consecutive ids
+            return static_cast<size_t>((name * 0x9E3779B97F4A7C15ULL) >> shift);
+        }
+
+        bool used(size_t slot) const {
+            return slots[slot].generation == generation;
+        }
+
+        void rehash(size_t capacity) {
+            std::vector<Slot> previous = std::move(slots);
+            slots.assign(capacity, Slot{Symbol{0, SymbolKind::NONE, 0, 0}, 0});
+            shift = 64;
+
+            for (size_t i = capacity; i > 1; i >>= 1)
+                --shift;
+
+            for (const Slot &old: previous) {
+                if (old.generation != generation)
+                    continue;
+
+                size_t slot = slotFor(old.symbol.name);
+
+                while (used(slot))
+                    slot = (slot + 1) & (slots.size() - 1);
+
+                slots[slot] = old;
+            }
+        }
+
+    public:
+        explicit SymbolTable(size_t expected = 0) {
+            rehash(16);
+            reserve(expected);
+        }
+
+        // makes room for expected symbols up front, so they are inserted without rehashing on the way
+        void reserve(size_t expected) {
+            size_t capacity = slots.size();
+
+            while (capacity < expected * 2)
+                capacity <<= 1;
+
+            if (capacity != slots.size())
+                rehash(capacity);
+        }
+
+        // adds symbol unless its name is taken, in which case the table is left alone and the symbol that already
+        // has the name is returned
+        const Symbol *insert(const Symbol &symbol) {
+            // the table is kept at most half full so probe sequences stay short
+            if ((count + 1) * 2 > slots.size())
+                rehash(slots.size() * 2);
+
+            size_t slot = slotFor(symbol.name);
+
+            for (; used(slot); slot = (slot + 1) & (slots.size() - 1)) {
+                if (slots[slot].symbol.name == symbol.name)
+                    return &slots[slot].symbol;
+            }
+
+            slots[slot] = Slot{symbol, generation};
+            ++count;
+
+            return nullptr;
+        }
+
+        const Symbol *find(uint32_t name) const {
+            for (size_t slot = slotFor(name); used(slot); slot = (slot + 1) & (slots.size() - 1)) {
+                if (slots[slot].symbol.name == name)
+                    return &slots[slot].symbol;
+            }
+
+            return nullptr;
+        }
+
+        Symbol *find(uint32_t name) {
+            return const_cast<Symbol *>(static_cast<const SymbolTable *>(this)->find(name));
+        }
+
+        // removes every symbol but keeps the slots, by moving to the next generation
+        void clear() {
+            count = 0;
+
+            if (++generation == 0) {
+                std::fill(slots.begin(), slots.end(), Slot{Symbol{0, SymbolKind::NONE, 0, 0}, 0});
+                generation = 1;
+            }
+        }
+
+        size_t size() const {
+            return count;
+        }
+    };
+
+    // markers name places in the code, which jumps and calls take as an address. definitions are used for the
+    // address of their string, as a plain number
+    TokenType symbolType(SymbolKind kind) {
+        return kind == SymbolKind::MARKER ? TokenType::LABEL : TokenType::NUMBER;
+    }
+
+    // where the lines of an assembly came from. the lines of the file being assembled are kept as they are, every
+    // file pasted in by %include gets a range of negative locations of its own, so its tokens can be told apart
+    // from the ones of the file that included it and errors can name the file
+    class SourceMap {
+    private:
+        struct Origin {
+            int base; // the location of a line is the negated base plus the line
+            std::string file;
+        };
+
+        std::string main;
+        std::vector<Origin> origins;
+        int next = 0;
+
+    public:
+        // starts a new assembly of fileName, - is stdin
+        void reset(const std::string &fileName) {
+            main = fileName == "-" ? "<stdin>" : fileName;
+            origins.clear();
+            next = 0;
+        }
+
+        // hands out the locations of a file with lines lines, returns the base to pass to locate
+        int add(const std::filesystem::path &path, int lines) {
+            std::error_code error;
+            std::filesystem::path relative = std::filesystem::relative(path, error);
+
+            origins.push_back(Origin{next, error || relative.empty() ? path.string() : relative.string()});
+            next += lines + 1;
+
+            return origins.back().base;
+        }
+
+        static int locate(int base, int line) {
+            return -(base + line);
+        }
+
+        // file:line, or just the line when the passes are run without a file name
+        std::string describe(int location) const {
+            if (location >= 0)
+                return main.empty() ? "line " + std::to_string(location) : main + ":" + std::to_string(location);
+
+            // the last file whose locations start before this one
+            int position = -location;
+            auto origin = std::upper_bound(origins.begin(), origins.end(), position,
+                                           [](int p, const Origin &o) { return p <= o.base; });
+
+            if (origin == origins.begin())
+                return "line " + std::to_string(position);
+
+            --origin;
+            return origin->file + ":" + std::to_string(position - origin->base);
+        }
+    };
+
+    SourceMap &sourceMap() {
+        static SourceMap map;
+        return map;
+    }
+
+    std::string describeLine(int lineFound) {
+        return sourceMap().describe(lineFound);
+    }
+
+    // existing is the declaration that came first in the source
+    void reportDuplicate(const Symbol &symbol, const Symbol &existing, const SymbolPool &names) {
+        std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Symbol '" << names.name(symbol.name)
+                  << "' is declared on" << termcolor::red << " " << describeLine(existing.lineFound)
+                  << termcolor::reset << " and again on" << termcolor::red << " " << describeLine(symbol.lineFound)
+                  << termcolor::reset << "\n\n";
+    }
+
+    // mnemonics and registers are recognized in any case, so a marker or definition named sub or Add could never
+    // be referenced, the name would be read as the keyword
+    bool isReservedName(std::string_view name) {
+        return findKeyword(name).kind != KeywordKind::NONE;
+    }
+
+    void reportReservedName(const Symbol &symbol, const SymbolPool &names) {
+        Keyword keyword = findKeyword(names.name(symbol.name));
+
+        std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Symbol '" << names.name(symbol.name)
+                  << "' on" << termcolor::red << " " << describeLine(symbol.lineFound) << termcolor::reset
+                  << " collides with the " << (keyword.kind == KeywordKind::OPCODE ? "mnemonic " : "register ")
+                  << keyword.name << ", markers and definitions can't be named after one in any case\n\n";
+    }
+
+    // declares a marker or definition, reports it and returns false when the name was declared before or belongs
+    // to a mnemonic or register
+    bool declareSymbol(SymbolTable &table, const Symbol &symbol, const SymbolPool &names) {
+        if (isReservedName(names.name(symbol.name))) {
+            reportReservedName(symbol, names);
+            return false;
+        }
+
+        const Symbol *existing = table.insert(symbol);
+
+        if (existing)
+            reportDuplicate(symbol, *existing, names);
+
+        return !existing;
+    }
+
+    struct LexDiagnostic {
+        const char *message;
+        int lineFound;
+    };
+
+    // everything the lexer has to remember between two chunks of the same source
+    struct LexState {
+        int lineFound = 1;
+        bool error = false;
+
+        // errors are collected instead of printed so that chunks lexed speculatively can throw theirs away
+        std::vector<LexDiagnostic> diagnostics;
+    };
+
+    void abortOnLexErrors(const LexState &state) {
+        if (!state.error)
+            return;
+
+        for (auto &d: state.diagnostics) {
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << d.message << termcolor::red << " "
+                      << describeLine(d.lineFound) << termcolor::reset;
+        }
+
+        std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Aborting due to errors while parsing\n";
+        std::exit(-1);
+    }
+
+    // lexes as much of code as possible and passes every token to sink, the tokens point into code so the sink
+    // has to copy whatever it wants to keep. when final is false the chunk is followed by more input and a token
+    // that runs into the end of the chunk is left alone, the returned position is where the next chunk should
+    // continue from. symbols is a SymbolPool, or UninternedNames for a lexer that leaves the names to another thread
+    template <typename Pool, typename Sink>
+    size_t lexChunk(std::string_view code, bool final, LexState &state, Pool &symbols, Sink &&sink) {
+        int &lineFound = state.lineFound;
+        const size_t size = code.size();
+        const char *codeEnd = code.data() + size;
+
+        for (size_t readingIndex = 0; readingIndex < size;) {
+            size_t start = readingIndex;
+            const Lex::StateInfo &info = Lex::states[Lex::match(code.data(), size, readingIndex)];
+
+            // the token might continue in the next chunk
+            if (!final && readingIndex == size && info.accept != Lex::Accept::BLANK
+                && info.accept != Lex::Accept::DIVIDER)
+                return start;
+
+            switch (info.accept) {
+                case Lex::Accept::BLANK:
+                    // lone separators are common enough to not be worth a call into the scanner
+                    if (readingIndex < size && Lex::startState(code[readingIndex]) == Lex::BLANK) {
+                        const char *next = Scan::active.skipWhitespace(code.data() + start, codeEnd, lineFound);
+                        readingIndex = next - code.data();
+                    } else {
+                        lineFound += code[start] == '\n';
+                    }
+                    break;
+                case Lex::Accept::MARKER: {
+                    uint32_t id = symbols.intern(code.substr(start + info.prefix, readingIndex - start - info.prefix));
+
+                    sink(Token{
+                            TokenType::MARKER,
+                            lineFound,
+                            symbols.name(id),
+                            id
+                    });
+                    break;
+                }
+                case Lex::Accept::DIRECTIVE:
+                    sink(Token{
+                            TokenType::DIRECTIVE,
+                            lineFound,
+                            code.substr(start + info.prefix, readingIndex - start - info.prefix),
+                            0
+                    });
+                    break;
+                case Lex::Accept::DIVIDER:
+                    sink(Token{
+                            TokenType::DIVIDER,
+                            lineFound,
+                            ",",
+                            0
+                    });
+                    break;
+                case Lex::Accept::IDENTIFIER: {
+                    std::string_view value = code.substr(start, readingIndex - start);
+                    uint32_t id = symbols.intern(value);
+
+                    sink(Token{
+                            TokenType::IDENTIFIER,
+                            lineFound,
+                            symbols.name(id),
+                            id
+                    });
+                    break;
+                }
+                case Lex::Accept::NUMBER:
+                case Lex::Accept::ADDRESS: {
+                    std::string_view digits = code.substr(start + info.prefix, readingIndex - start - info.prefix);
+                    uint32_t value = 0;
+
+                    if (!parseInteger(digits, info.base, value)) {
+                        state.diagnostics.push_back(LexDiagnostic{" Number does not fit in 32 bits on", lineFound});
+                        state.error = true;
+                    }
+
+                    sink(Token{
+                            info.accept == Lex::Accept::NUMBER ? TokenType::NUMBER : TokenType::ADDRESS,
+                            lineFound,
+                            "",
+                            value
+                    });
+
+                    break;
+                }
+                case Lex::Accept::STRING: {
+                    const char *close = Scan::active.findEither(code.data() + readingIndex, codeEnd, '\'', '"');
+
+                    if (!final && close == codeEnd)
+                        return start;
+
+                    // strings without escapes stay views into the source, the others are decoded into the pool
+                    std::string_view body = code.substr(readingIndex, close - code.data() - readingIndex);
+
+                    if (Scan::active.findByte(body.data(), close, '\\') != close) {
+                        char *decoded = symbols.allocate(body.size());
+                        size_t size = decodeEscapes(body, decoded);
+
+                        symbols.shrink(body.size() - size);
+                        body = std::string_view(decoded, size);
+                    }
+
+                    sink(Token{
+                            TokenType::STRING,
+                            lineFound,
+                            body,
+                            0
+                    });
+
+                    readingIndex = close == codeEnd ? size : close - code.data() + 1;
+                    break;
+                }
+                case Lex::Accept::COMMENT: {
+                    const char *newline = Scan::active.findByte(code.data() + readingIndex, codeEnd, '\n');
+
+                    if (!final && newline == codeEnd)
+                        return start;
+
+                    ++lineFound;
+                    readingIndex = newline == codeEnd ? size : newline - code.data() + 1;
+                    break;
+                }
+                case Lex::Accept::MALFORMED_NUMBER:
+                    state.diagnostics.push_back(LexDiagnostic{" Malformed number on", lineFound});
+                    state.error = true;
+                    break;
+                default:
+                    state.diagnostics.push_back(LexDiagnostic{" Unexpected symbol on", lineFound});
+                    state.error = true;
+                    readingIndex = start + 1;
+            }
+        }
+
+        return size;
+    }
+
+    // chunks smaller than this are not worth a thread of their own
+    const size_t PARALLEL_LEX_MIN_CHUNK = 1 << 16;
+
+    // a piece of the source lexed on a thread of its own. watch mode keeps the chunks between rebuilds, so their
+    // pools and tokens already have the memory the next build needs
+    struct LexedChunk {
+        size_t begin = 0;
+        size_t end = 0;
+        size_t consumed = 0; // absolute position the next chunk has to continue from
+        LexState state;      // lines relative to the start of the chunk
+        TokenStore tokens;
+        std::unique_ptr<SymbolPool> symbols; // symbol ids local to the chunk
+
+        // where the tokens, lines and spans of the chunk go in the stitched result, and the id every name of the
+        // chunk has there
+        size_t tokenOffset = 0;
+        size_t spanOffset = 0;
+        int lineOffset = 0;
+        std::vector<uint32_t> ids;
+    };
+
+    // what the passes only need while they run. watch mode keeps it in its workspace, every pass clears the parts
+    // it uses so after the first build they already have the capacity the next one needs
+    struct PassBuffers {
+        std::vector<std::thread> workers;                // joined before the pass that started them returns
+        std::vector<Keyword> keywords;                   // postTokenizer, the keyword of every name by id
+        std::vector<unsigned int> offsets;               // layoutInstructions, the offset of every instruction
+        std::vector<unsigned char> failed;               // generateBytecode, the instructions without an encoding
+        std::vector<std::vector<unsigned char>> encoded; // generateBytecode, one buffer per thread
+    };
+
+    void lexChunkInto(std::string_view code, LexedChunk &chunk, size_t from) {
+        chunk.tokens.clear();
+        chunk.symbols->clear();
+        chunk.state.lineFound = 0;
+        chunk.state.error = false;
+        chunk.state.diagnostics.clear();
+
+        std::string_view window = code.substr(from, chunk.end - from);
+        bool final = chunk.end == code.size();
+
+        chunk.consumed = from + lexChunk(window, final, chunk.state, *chunk.symbols, [&chunk](const Token &t) {
+            chunk.tokens.push(t);
+        });
+    }
+
+    // splits the source at newlines, lexes the pieces on separate threads and stitches the results together.
+    // every piece is lexed as if it started outside of a string, when that guess turns out wrong because a string
+    // spans the split the piece is lexed again from where the previous one really ended. the result is identical
+    // to lexing the whole source on one thread. decoded strings stay in the pools of the chunks, so the tokens are
+    // only valid as long as chunks is left alone
+    void lexParallel(std::string_view code, unsigned int jobs, LexState &state, SymbolPool &symbols,
+                     TokenStore &tokens, std::vector<LexedChunk> &chunks, PassBuffers &buffers) {
+        size_t pieces = std::min<size_t>(jobs, std::max<size_t>(1, code.size() / PARALLEL_LEX_MIN_CHUNK));
+        size_t count = 0;
+
+        for (size_t i = 0, begin = 0; i < pieces && begin < code.size(); i++) {
+            size_t end = i + 1 == pieces ? code.size() : code.size() / pieces * (i + 1);
+
+            if (end <= begin)
+                continue;
+
+            while (end < code.size() && code[end - 1] != '\n')
+                ++end;
+
+            // chunks left from an earlier build are reused with whatever they allocated
+            if (count == chunks.size())
+                chunks.emplace_back();
+
+            LexedChunk &chunk = chunks[count++];
+            chunk.begin = begin;
+            chunk.end = end;
+
+            if (!chunk.symbols)
+                chunk.symbols = std::make_unique<SymbolPool>();
+
+            begin = end;
+        }
+
+        std::vector<std::thread> &workers = buffers.workers;
+        workers.clear();
+
+        for (size_t i = 1; i < count; i++) {
+            workers.emplace_back([&code, &chunks, i]() {
+                lexChunkInto(code, chunks[i], chunks[i].begin);
+            });
+        }
+
+        if (count > 0)
+            lexChunkInto(code, chunks[0], 0);
+
+        for (auto &worker: workers)
+            worker.join();
+
+        // walk the chunks in order to find the ones that have to be redone and the offsets of the others
+        size_t tokenCount = 0;
+        size_t spanCount = 0;
+        size_t resume = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            LexedChunk &chunk = chunks[i];
+
+            if (resume != chunk.begin)
+                lexChunkInto(code, chunk, resume);
+
+            chunk.lineOffset = state.lineFound;
+            chunk.tokenOffset = tokenCount;
+            chunk.spanOffset = spanCount;
+            tokenCount += chunk.tokens.size();
+            spanCount += chunk.tokens.spans.size();
+
+            state.lineFound += chunk.state.lineFound;
+
+            for (auto &d: chunk.state.diagnostics)
+                state.diagnostics.push_back(LexDiagnostic{d.message, d.lineFound + chunk.lineOffset});
+
+            state.error |= chunk.state.error;
+            resume = chunk.consumed;
+
+            // interning in chunk order hands out the same ids as lexing on a single thread would
+            chunk.ids.clear();
+
+            for (uint32_t id = 0; id < chunk.symbols->size(); id++)
+                chunk.ids.push_back(symbols.intern(chunk.symbols->name(id)));
+        }
+
+        // move every chunk's tokens to their final place, fixing up the relative lines, symbol ids and spans
+        tokens.types.resize(tokenCount);
+        tokens.lines.resize(tokenCount);
+        tokens.values.resize(tokenCount);
+        tokens.spans.resize(spanCount);
+        workers.clear();
+
+        for (size_t i = 0; i < count; i++) {
+            workers.emplace_back([&tokens, &chunks, i]() {
+                const LexedChunk &lexed = chunks[i];
+                const TokenStore &chunk = lexed.tokens;
+                size_t offset = lexed.tokenOffset;
+
+                std::copy(chunk.types.begin(), chunk.types.end(), tokens.types.begin() + offset);
+                std::copy(chunk.spans.begin(), chunk.spans.end(), tokens.spans.begin() + lexed.spanOffset);
+
+                for (size_t t = 0; t < chunk.size(); t++) {
+                    uint32_t value = chunk.values[t];
+
+                    if (chunk.types[t] == TokenType::IDENTIFIER || chunk.types[t] == TokenType::MARKER)
+                        value = lexed.ids[value];
+                    else if (chunk.types[t] == TokenType::STRING || chunk.types[t] == TokenType::DIRECTIVE)
+                        value += lexed.spanOffset;
+
+                    tokens.lines[offset + t] = chunk.lines[t] + lexed.lineOffset;
+                    tokens.values[offset + t] = value;
+                }
+            });
+        }
+
+        for (auto &worker: workers)
+            worker.join();
+
+        workers.clear();
+    }
+
+    void lexParallel(std::string_view code, unsigned int jobs, LexState &state, SymbolPool &symbols,
+                     TokenStore &tokens, std::vector<LexedChunk> &chunks) {
+        PassBuffers buffers;
+        lexParallel(code, jobs, state, symbols, tokens, chunks, buffers);
+    }
+
+    // tokens is filled from scratch, whatever capacity it has left from an earlier assembly is reused. with more
+    // than one job the strings may point into chunks, which has to be kept as long as the tokens
+    void lexer(std::string_view code, SymbolPool &symbols, TokenStore &tokens, unsigned int jobs,
+               std::vector<LexedChunk> &chunks, PassBuffers &buffers) {
+        LexState state;
+        tokens.clear();
+
+        if (jobs > 1) {
+            lexParallel(code, jobs, state, symbols, tokens, chunks, buffers);
+        } else {
+            lexChunk(code, true, state, symbols, [&tokens](const Token &t) {
+                tokens.push(t);
+            });
+        }
+
+        abortOnLexErrors(state);
+    }
+
+    void lexer(std::string_view code, SymbolPool &symbols, TokenStore &tokens, unsigned int jobs = 1) {
+        std::vector<LexedChunk> chunks;
+        PassBuffers buffers;
+        lexer(code, symbols, tokens, jobs, chunks, buffers);
+
+        // decoded strings still point into the pools of the chunks
+        for (auto &chunk: chunks)
+            symbols.adopt(*chunk.symbols);
+    }
+
+    std::string stringifyToken(TokenType value) {
+        switch (value) {
+            case TokenType::IDENTIFIER:
+                return "identifier";
+            case TokenType::NUMBER:
+                return "number";
+            case TokenType::DIVIDER:
+                return "divider";
+            case TokenType::OPCODE:
+                return "opcode";
+            case TokenType::REGISTER:
+                return "register";
+            case TokenType::MARKER:
+                return "marker";
+            case TokenType::END:
+                return "end";
+            case TokenType::ADDRESS:
+                return "address";
+            case TokenType::STRING:
+                return "string";
+            case TokenType::LABEL:
+                return "label";
+            case TokenType::DIRECTIVE:
+                return "directive";
+            default:
+                return "unknown";
+        }
+    }
+
+    std::string stringifyTokenValue(Token t) {
+        if (t.type == TokenType::ADDRESS || t.type == TokenType::NUMBER || t.type == TokenType::LABEL)
+            return std::to_string(t.valNumeric);
+        else if (t.type == TokenType::STRING)
+            return escapeString(t.valString);
+        else
+            return std::string(t.valString);
+    }
+
+    void printTokens(const TokenStore &tokens, const SymbolPool &symbols) {
+        // included files are named with their lines, the column is as wide as the widest of them
+        size_t lineWidth = 0;
+
+        for (int line: tokens.lines)
+            lineWidth = std::max(lineWidth, describeLine(line).size());
+
+        int currentLineNumber = 0;
+
+        for (size_t i = 0; i < tokens.size(); i++) {
+            Token t = tokens.at(i, symbols);
+            int tokenTypePadding = 8 - stringifyToken(t.type).size();
+            std::string line = t.lineFound != currentLineNumber ? describeLine(t.lineFound) : ".";
+
+            currentLineNumber = t.lineFound;
+            std::cout << "  " << line << std::string(lineWidth - line.size(), ' ');
+
+            if (t.type == TokenType::ADDRESS || t.type == TokenType::NUMBER || t.type == TokenType::LABEL) {
+                std::cout
+                        << termcolor::blue << " | "
+                        << termcolor::reset << stringifyToken(t.type)
+                        << termcolor::blue << ": " << termcolor::reset;
+
+                for (int i = 0; i < tokenTypePadding; i++)
+                    std::cout << " ";
+
+                std::cout << t.valNumeric << "\n";
+            } else {
+                std::cout
+                        << termcolor::blue << " | "
+                        << termcolor::reset << stringifyToken(t.type) << termcolor::blue << ": " << termcolor::reset;
+
+                for (int i = 0; i < tokenTypePadding; i++)
+                    std::cout << " ";
+
+                std::cout << t.valString << "\n";
+            }
+        }
+    }
+
+    void printDefs(std::vector<Definition> &defs, const SymbolPool &symbols) {
+        int longestDefName = 0;
+        int longestDefAddr = 0;
+
+        // find the longest def name length
+        for (auto &d: defs) {
+            int defNameLength = symbols.name(d.name).size();
+            int defAddrLength;
+
+            if (d.index == 0) {
+                defAddrLength = 1;
+            } else {
+                defAddrLength = longestDefAddr - std::floor(std::log10(d.index));
+            }
+
+            if (defNameLength > longestDefName)
+                longestDefName = defNameLength;
+
+            if (defAddrLength > longestDefAddr)
+                longestDefAddr = defAddrLength;
+        }
+
+        for (auto &d: defs) {
+            int namePaddingAmount = longestDefName - symbols.name(d.name).size();
+            int addrPaddingAmount = 0;
+
+            if (d.index == 0) {
+                addrPaddingAmount = 1;
+            } else {
+                addrPaddingAmount = longestDefAddr - std::floor(std::log10(d.index));
+            }
+
+            std::cout << termcolor::blue << "  name: " << termcolor::reset << symbols.name(d.name) << ", ";
+
+            for (int i = 0; i < namePaddingAmount; i++)
+                std::cout << " ";
+
+            std::cout << termcolor::blue << "addr: " << termcolor::reset << d.index << ", ";
+
+            for (int i = 0; i < addrPaddingAmount; i++)
+                std::cout << " ";
+
+            std::cout << termcolor::blue << "str: " << termcolor::reset << "'" << escapeString(d.value) << "'"
+                      << termcolor::blue << "\n" << termcolor::reset;
+        }
+    }
+
+    void printMarkers(std::vector<Marker> &markers, const SymbolPool &symbols) {
+        int longestMarkerName = 0;
+
+        for (auto &m: markers) {
+            int currentMarkerLength = symbols.name(m.name).size();
+
+            if (currentMarkerLength > longestMarkerName) {
+                longestMarkerName = currentMarkerLength;
+            }
+        }
+
+        for (auto &m: markers) {
+            int markerNamePadding = longestMarkerName - symbols.name(m.name).size();
+            std::cout << termcolor::blue << "  name: " << termcolor::reset << symbols.name(m.name) << ", ";
+
+            for (int i = 0; i < markerNamePadding; i++)
+                std::cout << " ";
+
+            std::cout << termcolor::blue << "addr: " << termcolor::reset << m.byteIndex
+                      << termcolor::yellow << "\n" << termcolor::reset;
+        }
+    }
+
+    bool isTailOf(std::string_view value, std::string_view container) {
+        return value.size() <= container.size() && container.substr(container.size() - value.size()) == value;
+    }
+
+    // gives every definition its address in the data section. like linkers do for string tables, identical values
+    // share their storage and a value that is the tail of another one points into it, only the remaining values
+    // are stored, in the order they were defined
+    void layoutData(std::vector<Definition> &definitions) {
+        std::vector<unsigned int> order(definitions.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        // sorted by their reversed values every value comes right before the ones ending with it, identical
+        // values are ordered so that the first definition keeps the storage
+        std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+            std::string_view x = definitions[a].value, y = definitions[b].value;
+
+            if (x == y)
+                return a > b;
+
+            return std::lexicographical_compare(x.rbegin(), x.rend(), y.rbegin(), y.rend());
+        });
+
+        std::vector<unsigned int> owner(definitions.size());
+
+        for (size_t k = order.size(); k-- > 0;) {
+            unsigned int d = order[k];
+            std::string_view value = definitions[d].value;
+
+            owner[d] = d;
+            definitions[d].stored = true;
+
+            // the values ending with this one follow it
+            if (k + 1 < order.size() && isTailOf(value, definitions[order[k + 1]].value)) {
+                owner[d] = owner[order[k + 1]];
+                definitions[d].stored = false;
+            }
+        }
+
+        int index = 0;
+
+        for (auto &d: definitions) {
+            if (d.stored) {
+                d.index = index;
+                index += d.value.size();
+            }
+        }
+
+        for (unsigned int d = 0; d < definitions.size(); d++) {
+            const Definition &container = definitions[owner[d]];
+            definitions[d].index = container.index + container.value.size() - definitions[d].value.size();
+        }
+    }
+
+    [[noreturn]] void expectedGlobalName(int lineFound) {
+        std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Expected a name after %global on"
+                  << termcolor::red << " " << describeLine(lineFound) << termcolor::reset << "\n\n";
+        std::exit(-1);
+    }
+
+    void parseDefinitions(TokenStore &tokens, std::vector<Definition> &definitions) {
+        const std::vector<TokenType> &types = tokens.types;
+        const std::vector<uint32_t> &values = tokens.values;
+        size_t kept = 0;
+        definitions.clear();
+
+        // the definitions are taken out by moving the other tokens down in place
+        for (size_t i = 0; i < tokens.size(); i++) {
+            // only objects export symbols, an executable has nothing to export them to. every other directive was
+            // handled while expanding the includes
+            if (types[i] == TokenType::DIRECTIVE) {
+                if (i + 1 >= tokens.size() || types[i + 1] != TokenType::IDENTIFIER)
+                    expectedGlobalName(tokens.lines[i]);
+
+                ++i;
+                continue;
+            }
+
+            if (types[i] == TokenType::IDENTIFIER && values[i] == SymbolPool::DEF) {
+                if (i + 2 >= tokens.size() || types[i + 1] != TokenType::IDENTIFIER
+                    || types[i + 2] != TokenType::STRING) {
+                    std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                              << " Unknown syntax in definition statement on" << termcolor::red << " "
+                              << describeLine(tokens.lines[i]) << termcolor::reset;
+                    std::exit(-1);
+                }
+
+                definitions.push_back(Definition{
+                        0,
+                        tokens.span(i + 2),
+                        values[i + 1],
+                        tokens.lines[i],
+                        true,
+                        kept
+                });
+
+                i += 2;
+                continue;
+            }
+
+            tokens.move(i, kept++);
+        }
+
+        tokens.truncate(kept);
+
+        layoutData(definitions);
+    }
+
+    // replaces the references to markers and definitions by their addresses, markers that are not laid out yet
+    // give their instruction index. reports every name that was never declared and returns false if there was one
+    bool resolveIdentifiers(TokenStore &tokens, const SymbolTable &table, const SymbolPool &symbols) {
+        std::vector<TokenType> &types = tokens.types;
+        std::vector<uint32_t> &values = tokens.values;
+        bool resolved = true;
+
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (types[i] != TokenType::IDENTIFIER)
+                continue;
+
+            const Symbol *symbol = table.find(values[i]);
+
+            if (symbol) {
+                types[i] = symbolType(symbol->kind);
+                values[i] = symbol->address;
+            } else {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not match identifier '"
+                          << symbols.name(values[i]) << "' on" << termcolor::red << " "
+                          << describeLine(tokens.lines[i]) << termcolor::reset << "\n\n";
+                types[i] = TokenType::NUMBER;
+                resolved = false;
+            }
+        }
+
+        return resolved;
+    }
+
+    // table is cleared first, watch mode passes the same one to every build so its slots are only allocated once
+    void postTokenizer(TokenStore &tokens, std::vector<Marker> &markers, std::vector<Definition> &definitions,
+                       const SymbolPool &symbols, SymbolTable &table, PassBuffers &buffers) {
+        std::vector<TokenType> &types = tokens.types;
+        std::vector<uint32_t> &values = tokens.values;
+        std::vector<int> &lines = tokens.lines;
+        table.clear();
+        table.reserve(definitions.size());
+        unsigned int instructions = 0;
+        bool errors = false;
+
+        // the definitions were already taken out of the tokens, they are interleaved with the markers by the token
+        // that followed them so that everything is declared in source order, whatever file it came from
+        unsigned int nextDefinition = 0;
+
+        auto declareDefinitionsUpTo = [&](size_t token) {
+            while (nextDefinition < definitions.size() && definitions[nextDefinition].token <= token) {
+                Definition &d = definitions[nextDefinition++];
+                errors |= !declareSymbol(table, Symbol{d.name, SymbolKind::DEFINITION, d.index, d.lineFound}, symbols);
+            }
+        };
+
+        // whether a name is a mnemonic or register only depends on the name, so it is looked up once per name
+        std::vector<Keyword> &keywordsById = buffers.keywords;
+        keywordsById.clear();
+
+        for (uint32_t id = 0; id < symbols.size(); id++)
+            keywordsById.push_back(findKeyword(symbols.name(id)));
+
+        size_t kept = 0;
+
+        for (size_t i = 0; i < tokens.size(); i++) {
+            // identify the opcodes and registers
+            if (types[i] == TokenType::IDENTIFIER) {
+                const Keyword &keyword = keywordsById[values[i]];
+
+                if (keyword.kind != KeywordKind::NONE) {
+                    types[i] = keyword.kind == KeywordKind::OPCODE ? TokenType::OPCODE : TokenType::REGISTER;
+                    values[i] = keyword.index;
+                }
+            }
+
+            if (types[i] == TokenType::OPCODE)
+                ++instructions;
+
+            // markers
+            if (types[i] == TokenType::MARKER) {
+                declareDefinitionsUpTo(i);
+
+                // the address is only known after the layout pass, until then markers point at an instruction
+                markers.push_back(Marker{
+                        values[i],
+                        instructions,
+                        0,
+                        lines[i]
+                });
+
+                errors |= !declareSymbol(table, Symbol{values[i], SymbolKind::MARKER, (int) instructions, lines[i]},
+                                         symbols);
+            } else if (types[i] != TokenType::DIVIDER) {
+                // dividers only separate arguments, nothing after this needs them
+                tokens.move(i, kept++);
+            }
+        }
+
+        declareDefinitionsUpTo(std::numeric_limits<size_t>::max());
+
+        tokens.truncate(kept);
+        errors |= !resolveIdentifiers(tokens, table, symbols);
+
+        if (errors) {
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                      << " Aborting due to errors while analyzing semantics\n\n";
+            std::exit(-1);
+        }
+    }
+
+    void postTokenizer(TokenStore &tokens, std::vector<Marker> &markers, std::vector<Definition> &definitions,
+                       const SymbolPool &symbols) {
+        SymbolTable table;
+        PassBuffers buffers;
+        postTokenizer(tokens, markers, definitions, symbols, table, buffers);
+    }
+
+    void pushRegister(std::vector<unsigned char> &bytecode, uint32_t value) {
+        bytecode.push_back(value);
+    }
+
+    // big endian, width is the amount of bytes
+    void pushNumeric(std::vector<unsigned char> &bytecode, uint32_t value, unsigned int width = 4) {
+        for (unsigned int i = 0; i < width; i++) {
+            unsigned char byte = (value >> (8 * (width - 1 - i))) & 0xFF;
+            bytecode.push_back(byte);
+        }
+    }
+
+    // bytes every immediate of the instruction is stored in, they all share the narrowest width that fits the
+    // largest one. references to markers stay 32 bits since their value isn't known before layout
+    unsigned int immediateWidth(const Encoding &encoding, const TokenType *types, const uint32_t *values,
+                                size_t count, bool wide) {
+        if (wide || !encoding.narrow)
+            return 4;
+
+        uint32_t largest = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            if (types[i] == TokenType::LABEL)
+                return 4;
+
+            if (types[i] == TokenType::NUMBER || types[i] == TokenType::ADDRESS)
+                largest = std::max(largest, values[i]);
+        }
+
+        return largest <= 0xFF ? 1 : largest <= 0xFFFF ? 2 : 4;
+    }
+
+    unsigned char immediateOpcode(const Encoding &encoding, unsigned int width) {
+        return width == 1 ? encoding.imm8 : width == 2 ? encoding.imm16 : encoding.opcode;
+    }
+
+    // encodes a single instruction and returns false when the mnemonic has no encoding for these arguments, all
+    // bytes are written either way so that positions stay meaningful. the arguments are given as their type and
+    // value columns. immediates use the narrowest form unless wide is set. when argumentOffsets is given it
+    // receives the position every argument was written to so that the caller can patch them later
+    bool encodeInstruction(std::vector<unsigned char> &bytecode, unsigned int mnemonic, const TokenType *types,
+                           const uint32_t *values, size_t count, bool wide,
+                           std::vector<unsigned int> *argumentOffsets = nullptr) {
+        Encoding encoding = findEncoding(mnemonic, types, count);
+        unsigned int width = immediateWidth(encoding, types, values, count, wide);
+
+        bytecode.push_back(immediateOpcode(encoding, width));
+
+        if (argumentOffsets)
+            argumentOffsets->clear();
+
+        // translate the arguments to bytecode and add them to the buffer
+        for (size_t j = 0; j < count; j++) {
+            if (argumentOffsets)
+                argumentOffsets->push_back(bytecode.size());
+
+            switch (types[j]) {
+                case TokenType::REGISTER:
+                    pushRegister(bytecode, values[j]);
+                    break;
+                case TokenType::ADDRESS:
+                case TokenType::NUMBER:
+                case TokenType::LABEL:
+                    pushNumeric(bytecode, values[j], width);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return encoding.valid;
+    }
+
+    void reportUnknownEncoding(unsigned int mnemonic, int lineFound, const std::vector<TokenType> &types) {
+        std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " " << mnemonics[mnemonic].name
+                  << " does not take (";
+
+        for (size_t i = 0; i < types.size(); i++)
+            std::cout << (i ? ", " : "") << stringifyToken(types[i]);
+
+        std::cout << ") on" << termcolor::red << " " << describeLine(lineFound) << termcolor::reset << "\n\n";
+    }
+
+    struct Crc32Table {
+        uint32_t entries[256] = {};
+    };
+
+    constexpr Crc32Table buildCrc32Table() {
+        Crc32Table table;
+
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+
+            for (int bit = 0; bit < 8; bit++)
+                crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+
+            table.entries[i] = crc;
+        }
+
+        return table;
+    }
+
+    constexpr Crc32Table crc32Table = buildCrc32Table();
+
+    // the crc32 zlib and png use
+    uint32_t crc32(const void *data, size_t size) {
+        const unsigned char *bytes = static_cast<const unsigned char *>(data);
+        uint32_t crc = 0xFFFFFFFFu;
+
+        for (size_t i = 0; i < size; i++)
+            crc = crc32Table.entries[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+
+        return ~crc;
+    }
+
+    struct ImageOptions {
+        bool legacy = false;   // data, magic and version, then code, without a section table
+        bool symbols = false;  // add a section with the addresses of the markers and definitions
+        bool compress = false; // store the sections as Lz streams
+    };
+
+    ImageOptions imageOptions(cxxopts::ParseResult &result) {
+        return ImageOptions{result.count("legacy") > 0, result.count("symbols") > 0, result.count("compress") > 0};
+    }
+
+    // a container starts with a header and a section table, every section starts at a multiple of
+    // SECTION_ALIGNMENT so a loader can map it as it is. every number is big endian like the operands in the code
+    //   0  "CCBC"
+    //   4  CCBC_CONTAINER_VERSION
+    //   8  SECTION_ALIGNMENT
+    //  12  amount of sections
+    //  16  crc32 of the section table
+    //  20  section table, per section its kind and flags (2 bytes each), the crc32 of what is stored (4 bytes) and
+    //      its offset and stored size (8 bytes each)
+    enum class SectionKind : uint16_t {
+        DATA = 1,
+        CODE = 2,
+        SYMBOLS = 3,
+        RELOCATIONS = 4 // only in object files
+    };
+
+    // the section is an Lz stream that decompresses to the actual contents
+    constexpr uint16_t SECTION_COMPRESSED = 1;
+
+    constexpr size_t SECTION_ALIGNMENT = 4096;
+    constexpr size_t CONTAINER_HEADER_SIZE = 20;
+    constexpr size_t SECTION_ENTRY_SIZE = 24;
+
+    // a piece of the output file, written from wherever it already is
+    struct ImagePart {
+        const void *data;
+        size_t size;
+    };
+
+    void pushBigEndian(std::vector<char> &buffer, uint64_t value, unsigned int width) {
+        for (unsigned int i = 0; i < width; i++)
+            buffer.push_back(static_cast<char>((value >> (8 * (width - 1 - i))) & 0xFF));
+    }
+
+    uint64_t readBigEndian(const char *p, unsigned int width) {
+        uint64_t value = 0;
+
+        for (unsigned int i = 0; i < width; i++)
+            value = value << 8 | static_cast<unsigned char>(p[i]);
+
+        return value;
+    }
+
+    // the stored definitions back to back, the size is known up front so every byte is copied exactly once
+    std::vector<char> dataSection(const std::vector<Definition> &definitions) {
+        size_t size = 0;
+
+        for (auto &d: definitions) {
+            if (d.stored)
+                size += d.value.size();
+        }
+
+        std::vector<char> data(size);
+        char *destination = data.data();
+
+        // the escapes were already decoded by the lexer
+        for (auto &d: definitions) {
+            if (d.stored && !d.value.empty()) {
+                std::memcpy(destination, d.value.data(), d.value.size());
+                destination += d.value.size();
+            }
+        }
+
+        return data;
+    }
+
+    // amount of entries, then per entry its kind (1 byte), address (4 bytes), name length (2 bytes) and name
+    std::vector<char> symbolSection(const std::vector<Definition> &definitions, const std::vector<Marker> &markers,
+                                    const SymbolPool &symbols) {
+        std::vector<char> section;
+        pushBigEndian(section, definitions.size() + markers.size(), 4);
+
+        auto push = [&](SymbolKind kind, int address, uint32_t name) {
+            std::string_view text = symbols.name(name);
+
+            section.push_back(static_cast<char>(kind));
+            pushBigEndian(section, address, 4);
+            pushBigEndian(section, text.size(), 2);
+            section.insert(section.end(), text.begin(), text.end());
+        };
+
+        for (auto &d: definitions)
+            push(SymbolKind::DEFINITION, d.index, d.name);
+
+        for (auto &m: markers)
+            push(SymbolKind::MARKER, m.byteIndex, m.name);
+
+        return section;
+    }
+
+    void couldNotWrite(const std::string &fileName) {
+        std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not write file '" << fileName
+                  << "'\n\n";
+        std::exit(-1);
+    }
+
+    // writes the parts one after the other, with a single writev where there is one
+    void writeParts(const std::string &fileName, const std::vector<ImagePart> &parts) {
+#ifndef _WIN32
+        int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if (fd == -1)
+            couldNotWrite(fileName);
+
+        std::vector<iovec> vectors;
+
+        for (auto &p: parts)
+            vectors.push_back(iovec{const_cast<void *>(p.data), p.size});
+
+        iovec *part = vectors.data();
+        int remaining = vectors.size();
+
+        // large images can take more than one call
+        while (remaining > 0) {
+            ssize_t written = writev(fd, part, remaining);
+
+            if (written < 0) {
+                close(fd);
+                couldNotWrite(fileName);
+            }
+
+            while (remaining > 0 && static_cast<size_t>(written) >= part->iov_len) {
+                written -= part->iov_len;
+                ++part;
+                --remaining;
+            }
+
+            if (remaining > 0) {
+                part->iov_base = static_cast<char *>(part->iov_base) + written;
+                part->iov_len -= written;
+            }
+        }
+
+        close(fd);
+#else
+        std::ofstream file(fileName, std::ios::binary);
+
+        if (!file.is_open())
+            couldNotWrite(fileName);
+
+        for (auto &p: parts)
+            file.write(static_cast<const char *>(p.data), p.size);
+#endif
+    }
+
+    struct Section {
+        SectionKind kind;
+        uint16_t flags;
+        ImagePart part;
+    };
+
+    // writes the sections as a container, compressing them when asked to
+    void writeContainer(const std::string &fileName, std::vector<Section> sections, bool compress) {
+        static const char padding[SECTION_ALIGNMENT] = {};
+        const char magic[] = {'C', 'C', 'B', 'C', CCBC_CONTAINER_VERSION};
+
+        std::vector<std::vector<unsigned char>> compressed;
+
+        // sections that don't get smaller, like empty ones, are stored as they are
+        if (compress) {
+            compressed.reserve(sections.size());
+
+            for (auto &section: sections) {
+                ImagePart &part = section.part;
+                compressed.push_back(Lz::compress(static_cast<const unsigned char *>(part.data), part.size));
+
+                if (compressed.back().size() < part.size) {
+                    part = ImagePart{compressed.back().data(), compressed.back().size()};
+                    section.flags |= SECTION_COMPRESSED;
+                }
+            }
+        }
+
+        auto align = [](uint64_t offset) {
+            return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+        };
+
+        std::vector<char> table;
+        std::vector<ImagePart> parts;
+        uint64_t offset = align(CONTAINER_HEADER_SIZE + SECTION_ENTRY_SIZE * sections.size());
+
+        for (auto &section: sections) {
+            pushBigEndian(table, static_cast<uint16_t>(section.kind), 2);
+            pushBigEndian(table, section.flags, 2);
+            pushBigEndian(table, crc32(section.part.data, section.part.size), 4);
+            pushBigEndian(table, offset, 8);
+            pushBigEndian(table, section.part.size, 8);
+
+            offset = align(offset + section.part.size);
+        }
+
+        std::vector<char> header(magic, magic + sizeof(magic));
+        pushBigEndian(header, SECTION_ALIGNMENT, 4);
+        pushBigEndian(header, sections.size(), 4);
+        pushBigEndian(header, crc32(table.data(), table.size()), 4);
+        header.insert(header.end(), table.begin(), table.end());
+
+        parts.push_back({header.data(), header.size()});
+        uint64_t written = header.size();
+
+        for (auto &section: sections) {
+            parts.push_back({padding, align(written) - written});
+            parts.push_back(section.part);
+            written = align(written) + section.part.size;
+        }
+
+        writeParts(fileName, parts);
+    }
+
+    void writeImage(const std::vector<Definition> &definitions, const std::vector<Marker> &markers,
+                    const SymbolPool &symbols, const std::vector<unsigned char> &bytecode,
+                    const std::string &fileName, const ImageOptions &options) {
+        const char bytecodeHeader[] = {(char)0xDE, (char)0xAD, (char)0xBE, (char)0xEF, CCBC_VERSION};
+
+        std::vector<char> data = dataSection(definitions);
+
+        if (options.legacy) {
+            writeParts(fileName, {{data.data(), data.size()}, {bytecodeHeader, sizeof(bytecodeHeader)},
+                                  {bytecode.data(), bytecode.size()}});
+            return;
+        }
+
+        std::vector<char> symbolData;
+
+        std::vector<Section> sections = {
+                {SectionKind::DATA, 0, {data.data(), data.size()}},
+                {SectionKind::CODE, 0, {bytecode.data(), bytecode.size()}}
+        };
+
+        if (options.symbols) {
+            symbolData = symbolSection(definitions, markers, symbols);
+            sections.push_back({SectionKind::SYMBOLS, 0, {symbolData.data(), symbolData.size()}});
+        }
+
+        writeContainer(fileName, sections, options.compress);
+    }
+
+    struct LoadedSection {
+        SectionKind kind;
+        std::string_view contents;
+        std::vector<unsigned char> storage; // the decompressed contents, uncompressed sections point into the file
+    };
+
+    // an executable read back with its checksums verified, the sections are located through the section table
+    // without looking at anything else. images in the legacy layout can't be loaded
+    class LoadedImage {
+    private:
+        SourceFile file;
+        std::vector<LoadedSection> sections;
+
+        [[noreturn]] void invalid(const std::string &fileName, const char *reason) {
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " '" << fileName
+                      << "' is not a valid executable, " << reason << "\n\n";
+            std::exit(-1);
+        }
+
+    public:
+        // compressed sections are decompressed on the given amount of threads
+        explicit LoadedImage(const std::string &fileName, unsigned int jobs = 1) : file(fileName) {
+            const char magic[] = {'C', 'C', 'B', 'C', CCBC_CONTAINER_VERSION};
+            std::string_view image = file.view();
+
+            if (image.size() < CONTAINER_HEADER_SIZE || image.compare(0, sizeof(magic),
+                                                                       std::string_view(magic, sizeof(magic))) != 0)
+                invalid(fileName, "the header is missing");
+
+            uint64_t count = readBigEndian(image.data() + 12, 4);
+
+            if (count > (image.size() - CONTAINER_HEADER_SIZE) / SECTION_ENTRY_SIZE)
+                invalid(fileName, "the section table is cut off");
+
+            std::string_view table = image.substr(CONTAINER_HEADER_SIZE, count * SECTION_ENTRY_SIZE);
+
+            if (crc32(table.data(), table.size()) != readBigEndian(image.data() + 16, 4))
+                invalid(fileName, "the section table is damaged");
+
+            for (uint64_t i = 0; i < count; i++) {
+                const char *entry = table.data() + i * SECTION_ENTRY_SIZE;
+                uint16_t flags = readBigEndian(entry + 2, 2);
+                uint64_t offset = readBigEndian(entry + 8, 8);
+                uint64_t size = readBigEndian(entry + 16, 8);
+
+                if (offset > image.size() || size > image.size() - offset)
+                    invalid(fileName, "a section lies outside of the file");
+
+                LoadedSection section{static_cast<SectionKind>(readBigEndian(entry, 2)), image.substr(offset, size),
+                                      {}};
+
+                if (crc32(section.contents.data(), section.contents.size()) != readBigEndian(entry + 4, 4))
+                    invalid(fileName, "a section is damaged");
+
+                if (flags & SECTION_COMPRESSED) {
+                    if (!Lz::decompress(reinterpret_cast<const unsigned char *>(section.contents.data()),
+                                        section.contents.size(), section.storage, jobs))
+                        invalid(fileName, "a compressed section is malformed");
+
+                    section.contents = std::string_view(reinterpret_cast<const char *>(section.storage.data()),
+                                                        section.storage.size());
+                }
+
+                sections.push_back(std::move(section));
+            }
+        }
+
+        // the contents of the first section of the kind, nullptr when there is none
+        const LoadedSection *find(SectionKind kind) const {
+            for (auto &section: sections) {
+                if (section.kind == kind)
+                    return &section;
+            }
+
+            return nullptr;
+        }
+    };
+
+    enum class BranchForm : unsigned char {
+        NONE, // not a branch to a marker, encoded like any other instruction
+        REL8,
+        REL16,
+        ABSOLUTE
+    };
+
+    // where an instruction ends up in the bytecode
+    struct InstructionLayout {
+        unsigned int token;  // index of the opcode token
+        unsigned int count;  // amount of arguments following it
+        unsigned int offset;
+        unsigned int size;
+        BranchForm form;
+        unsigned int target; // instruction a short branch jumps to
+    };
+
+    // size encodeInstruction will produce for these arguments
+    unsigned int encodedSize(unsigned int mnemonic, const TokenType *types, const uint32_t *values, size_t count,
+                             bool wide) {
+        unsigned int width = immediateWidth(findEncoding(mnemonic, types, count), types, values, count, wide);
+        unsigned int size = 1;
+
+        for (size_t i = 0; i < count; i++)
+            size += types[i] == TokenType::REGISTER ? 1 : width;
+
+        return size;
+    }
+
+    unsigned int branchSize(BranchForm form) {
+        return form == BranchForm::REL8 ? 2 : 3;
+    }
+
+    BranchForm smallestBranchForm(int displacement) {
+        if (displacement >= -128 && displacement <= 127)
+            return BranchForm::REL8;
+
+        if (displacement >= -32768 && displacement <= 32767)
+            return BranchForm::REL16;
+
+        return BranchForm::ABSOLUTE;
+    }
+
+    // whether the instruction is a branch to a marker, which can use one of the short forms
+    bool isShortBranch(unsigned int mnemonic, const TokenType *types, size_t count) {
+        return count == 1 && types[0] == TokenType::LABEL && shortBranches.branches[mnemonic].valid;
+    }
+
+    void encodeShortBranch(std::vector<unsigned char> &bytecode, unsigned int mnemonic, BranchForm form,
+                           int displacement) {
+        const ShortBranch &branch = shortBranches.branches[mnemonic];
+
+        if (form == BranchForm::REL8) {
+            bytecode.push_back(branch.rel8);
+            bytecode.push_back(displacement & 0xFF);
+        } else {
+            bytecode.push_back(branch.rel16);
+            bytecode.push_back((displacement >> 8) & 0xFF);
+            bytecode.push_back(displacement & 0xFF);
+        }
+    }
+
+    // fewer instructions than this per thread are not worth starting one for
+    const size_t PARALLEL_ENCODE_MIN_INSTRUCTIONS = 1 << 14;
+
+    // splits [0, count) into one range per thread and calls function(first, last, range) for each of them, the
+    // first range runs on the calling thread. range numbers the ranges from 0 to jobs
+    template <typename Function>
+    void forEachRange(size_t count, unsigned int jobs, std::vector<std::thread> &workers, Function &&function) {
+        jobs = std::max<size_t>(1, std::min<size_t>(jobs, count / PARALLEL_ENCODE_MIN_INSTRUCTIONS));
+
+        if (jobs == 1) {
+            function(size_t(0), count, 0u);
+            return;
+        }
+
+        workers.clear();
+
+        for (unsigned int j = 1; j < jobs; j++)
+            workers.emplace_back(function, count * j / jobs, count * (j + 1) / jobs, j);
+
+        function(size_t(0), count / jobs, 0u);
+
+        for (auto &worker: workers)
+            worker.join();
+
+        workers.clear();
+    }
+
+    // works out the size and position of every instruction. branches to markers start out in their shortest form
+    // and only ever grow until every one of them reaches its target, which always terminates. afterwards markers
+    // and label references hold addresses instead of instruction indices. when wide is set branches keep their
+    // absolute form and immediates their 32 bit form. tokens in front of the first opcode are not part of any
+    // instruction. the sizes of everything but the branches are worked out on jobs threads
+    void layoutInstructions(TokenStore &tokens, std::vector<Marker> &markers, bool wide,
+                            std::vector<InstructionLayout> &instructions, unsigned int jobs, PassBuffers &buffers) {
+        const TokenType *types = tokens.types.data();
+        uint32_t *values = tokens.values.data();
+        instructions.clear();
+
+        for (unsigned int i = 0; i < tokens.size(); i++) {
+            if (types[i] != TokenType::OPCODE)
+                continue;
+
+            unsigned int count = 0;
+
+            while (i + count + 1 < tokens.size() && types[i + count + 1] != TokenType::OPCODE)
+                ++count;
+
+            InstructionLayout layout{i, count, 0, 0, BranchForm::NONE, 0};
+
+            if (!wide && isShortBranch(values[i], types + i + 1, count)) {
+                layout.form = BranchForm::REL8;
+                layout.size = branchSize(layout.form);
+                layout.target = values[i + 1];
+            }
+
+            instructions.push_back(layout);
+            i += count;
+        }
+
+        forEachRange(instructions.size(), jobs, buffers.workers, [&](size_t first, size_t last, unsigned int) {
+            for (size_t i = first; i < last; i++) {
+                InstructionLayout &layout = instructions[i];
+                unsigned int t = layout.token;
+
+                if (layout.form == BranchForm::NONE)
+                    layout.size = encodedSize(values[t], types + t + 1, values + t + 1, layout.count, wide);
+            }
+        });
+
+        // a marker after the last instruction points at the end of the bytecode
+        std::vector<unsigned int> &offsets = buffers.offsets;
+        offsets.assign(instructions.size() + 1, 0);
+        bool changed = true;
+
+        while (changed) {
+            changed = false;
+
+            for (unsigned int i = 0; i < instructions.size(); i++)
+                offsets[i + 1] = offsets[i] + instructions[i].size;
+
+            for (unsigned int i = 0; i < instructions.size(); i++) {
+                InstructionLayout &layout = instructions[i];
+
+                if (layout.form != BranchForm::REL8 && layout.form != BranchForm::REL16)
+                    continue;
+
+                int displacement = (int) offsets[layout.target] - (int) (offsets[i] + layout.size);
+                BranchForm needed = smallestBranchForm(displacement);
+
+                if (needed > layout.form) {
+                    layout.form = needed;
+                    layout.size = needed == BranchForm::ABSOLUTE ? 5 : branchSize(needed);
+                    changed = true;
+                }
+            }
+        }
+
+        for (unsigned int i = 0; i < instructions.size(); i++)
+            instructions[i].offset = offsets[i];
+
+        for (auto &m: markers)
+            m.byteIndex = offsets[m.instruction];
+
+        for (size_t i = 0; i < tokens.size(); i++) {
+            if (types[i] == TokenType::LABEL)
+                values[i] = offsets[values[i]];
+        }
+    }
+
+    void layoutInstructions(TokenStore &tokens, std::vector<Marker> &markers, bool wide,
+                            std::vector<InstructionLayout> &instructions, unsigned int jobs = 1) {
+        PassBuffers buffers;
+        layoutInstructions(tokens, markers, wide, instructions, jobs, buffers);
+    }
+
+    // the encoders of several threads fill a buffer of this size and copy it to its place in the bytecode, which
+    // keeps what they copy in the cache
+    const size_t PARALLEL_ENCODE_BUFFER_SIZE = 1 << 16;
+
+    // encodes the instructions on jobs threads. the layout gives every instruction its offset, so each thread
+    // writes a range of them straight to its own part of the bytecode and the result is the same as on one thread
+    void generateBytecode(const TokenStore &tokens, const std::vector<InstructionLayout> &instructions, bool wide,
+                          const SymbolPool &symbols, std::vector<unsigned char> &bytecode, unsigned int jobs,
+                          PassBuffers &buffers) {
+        const TokenType *types = tokens.types.data();
+        const uint32_t *values = tokens.values.data();
+        bytecode.clear();
+
+        // if the tokens don't start with an opcode, something must've gone wrong, error
+        if (!tokens.empty() && types[0] != TokenType::OPCODE) {
+            Token stray = tokens.at(0, symbols);
+
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Expected opcode on "
+                      << describeLine(stray.lineFound) << " got " << stringifyToken(stray.type) << ": "
+                      << stringifyTokenValue(stray) << "\n";
+            std::exit(-1);
+        }
+
+        // appends the instruction to output, false when its arguments have no encoding
+        auto encode = [&](const InstructionLayout &layout, std::vector<unsigned char> &output) {
+            unsigned int mnemonic = values[layout.token];
+            const TokenType *argumentTypes = types + layout.token + 1;
+            const uint32_t *argumentValues = values + layout.token + 1;
+
+            if (layout.form == BranchForm::REL8 || layout.form == BranchForm::REL16) {
+                int displacement = (int) argumentValues[0] - (int) (layout.offset + layout.size);
+                encodeShortBranch(output, mnemonic, layout.form, displacement);
+                return true;
+            }
+
+            return encodeInstruction(output, mnemonic, argumentTypes, argumentValues, layout.count, wide);
+        };
+
+        // the layout already knows how large the code is
+        size_t size = instructions.empty() ? 0 : instructions.back().offset + instructions.back().size;
+        std::vector<unsigned char> &failed = buffers.failed;
+        failed.assign(instructions.size(), 0);
+
+        if (instructions.size() < 2 * PARALLEL_ENCODE_MIN_INSTRUCTIONS || jobs <= 1) {
+            bytecode.reserve(size);
+
+            for (size_t i = 0; i < instructions.size(); i++)
+                failed[i] = !encode(instructions[i], bytecode);
+        } else {
+            bytecode.resize(size);
+
+            if (buffers.encoded.size() < jobs)
+                buffers.encoded.resize(jobs);
+
+            auto encodeRange = [&](size_t first, size_t last, unsigned int range) {
+                std::vector<unsigned char> &buffer = buffers.encoded[range];
+                buffer.reserve(PARALLEL_ENCODE_BUFFER_SIZE + 64);
+                bool valid = true;
+
+                for (size_t i = first; i < last;) {
+                    unsigned int offset = instructions[i].offset;
+                    buffer.clear();
+
+                    for (; i < last && buffer.size() < PARALLEL_ENCODE_BUFFER_SIZE; i++) {
+                        failed[i] = !encode(instructions[i], buffer);
+                        valid &= !failed[i];
+                    }
+
+                    // instructions without an encoding don't have the size the layout gave them
+                    if (valid)
+                        std::memcpy(bytecode.data() + offset, buffer.data(), buffer.size());
+                }
+            };
+
+            forEachRange(instructions.size(), jobs, buffers.workers, encodeRange);
+        }
+
+        bool error = false;
+
+        for (size_t i = 0; i < instructions.size(); i++) {
+            if (!failed[i])
+                continue;
+
+            const InstructionLayout &layout = instructions[i];
+            const TokenType *argumentTypes = types + layout.token + 1;
+
+            reportUnknownEncoding(values[layout.token], tokens.lines[layout.token],
+                                  std::vector<TokenType>(argumentTypes, argumentTypes + layout.count));
+            error = true;
+        }
+
+        if (error) {
             std::cout << termcolor::red << "[ERROR]" << termcolor::reset
                       << " Aborting due to errors while generating executable\n\n";
             std::exit(-1);
         }
+    }
+
+    void generateBytecode(const TokenStore &tokens, const std::vector<InstructionLayout> &instructions, bool wide,
+                          const SymbolPool &symbols, std::vector<unsigned char> &bytecode, unsigned int jobs = 1) {
+        PassBuffers buffers;
+        generateBytecode(tokens, instructions, wide, symbols, bytecode, jobs, buffers);
+    }
+
+    // input is read from pipes in chunks of this size, the buffer only grows when a single token is larger
+    const size_t STREAM_CHUNK_SIZE = 1 << 20;
+
+    // source text is lexed this much at a time when tokens are pulled, so the tokens of a window are still in the
+    // cache when the next stage gets them
+    const size_t PULL_WINDOW_SIZE = 1 << 12;
+
+    // takes the place of a symbol pool for a lexer whose names are interned on another thread. every name is
+    // handed back as it is, so the tokens carry the name and no id, strings are decoded into an arena of its own
+    class UninternedNames {
+    private:
+        Arena strings;
+        std::string_view last;
+
+    public:
+        // the lexer asks for the name right after interning it
+        uint32_t intern(std::string_view name) {
+            last = name;
+            return 0;
+        }
+
+        std::string_view name(uint32_t) const {
+            return last;
+        }
+
+        char *allocate(size_t size) {
+            return strings.allocate(size);
+        }
+
+        void shrink(size_t unused) {
+            strings.shrink(unused);
+        }
+    };
+
+    // pull based lexer, every call to next hands out the next token of a mapped source or of a pipe. the source is
+    // lexed a window at a time into a small buffer of tokens, so the stages after it never see more than a window
+    // worth of tokens at once. a token points into the source or the pool, for pipes only until the next call
+    template <typename Pool>
+    class BasicTokenGenerator {
+    private:
+        std::string_view code;
+        FILE *input = nullptr;
+        std::vector<char> buffer;
+        bool exhausted = true; // nothing left to read, everything after position is all the input there is
+
+        LexState &state;
+        Pool &symbols;
+
+        size_t position = 0;
+        size_t window = PULL_WINDOW_SIZE;
+        std::vector<Token> tokens;
+        size_t index = 0;
+
+        // moves the part of the buffer that is left to the front and reads more behind it
+        void read() {
+            size_t left = code.size() - position;
+
+            // the leftover token fills the whole buffer, make room for the rest of it
+            if (left == buffer.size())
+                buffer.resize(buffer.size() * 2);
+
+            std::memmove(buffer.data(), buffer.data() + position, left);
+
+            size_t count = std::fread(buffer.data() + left, 1, buffer.size() - left, input);
+
+            // the input breaking off is not the end of it, assembling what was read would write a truncated program
+            if (std::ferror(input)) {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not read the input\n\n";
+                std::exit(-1);
+            }
+
+            exhausted = count == 0 && std::feof(input);
+            code = std::string_view(buffer.data(), left + count);
+            position = 0;
+        }
+
+        // lexes windows until one of them had a token in it, returns false at the end of the input
+        bool refill() {
+            tokens.clear();
+            index = 0;
+
+            while (tokens.empty()) {
+                size_t left = code.size() - position;
+
+                if (left == 0 && exhausted)
+                    return false;
+
+                size_t size = std::min(left, window);
+                bool final = exhausted && size == left;
+                size_t consumed = lexChunk(code.substr(position, size), final, state, symbols,
+                                                 [this](const Token &t) {
+                                                     tokens.push_back(t);
+                                                 });
+                position += consumed;
+
+                // a window that was grown for a long token goes back to its size once the token is through
+                if (consumed > 0)
+                    window = PULL_WINDOW_SIZE;
+
+                if (consumed > 0 || final)
+                    continue;
+
+                // a single token doesn't fit, either in the window or in what was read so far
+                if (size < left)
+                    window *= 2;
+                else
+                    read();
+            }
+
+            return true;
+        }
+
+    public:
+        BasicTokenGenerator(std::string_view _code, LexState &_state, Pool &_symbols)
+                : code(_code), state(_state), symbols(_symbols) {
+            tokens.reserve(window);
+        }
+
+        BasicTokenGenerator(FILE *_input, LexState &_state, Pool &_symbols)
+                : input(_input), buffer(STREAM_CHUNK_SIZE), exhausted(false), state(_state), symbols(_symbols) {
+            tokens.reserve(window);
+        }
+
+        bool next(Token &t) {
+            if (index == tokens.size() && !refill())
+                return false;
+
+            t = tokens[index++];
+            return true;
+        }
+    };
+
+    using TokenGenerator = BasicTokenGenerator<SymbolPool>;
+
+    // tokens go from the lexing thread to the assembling one in batches of this size, with at most this many
+    // batches on their way at once
+    const size_t PIPELINE_BATCH_SIZE = 1 << 10;
+    const size_t PIPELINE_BATCHES = 16;
+
+    // reads and lexes the source on a thread of its own while the tokens are pulled on the calling one, so the
+    // lexer runs ahead while the later stages resolve and encode. the batches cycle through two rings, filled ones
+    // to the caller and emptied ones back to the lexer, so nothing is allocated once they have grown. the lexing
+    // thread only finds the names, they are interned into symbols on the calling thread as they come out, which
+    // gives them the same ids as lexing on the calling thread and keeps a single pool of them
+    class PipelinedLexer {
+    private:
+        struct Batch {
+            std::vector<Token> tokens;
+            Arena strings; // the names and strings of the tokens of a pipe
+            bool last = false;
+        };
+
+        SymbolPool &symbols;
+        UninternedNames names; // only touched by the lexing thread
+        BasicTokenGenerator<UninternedNames> generator;
+
+        // pipes reuse their buffer, so the text of the tokens is copied into the batch before they are handed over
+        bool copyStrings;
+
+        std::vector<Batch> batches;
+        SpscRing<unsigned int> filled;
+        SpscRing<unsigned int> emptied; // has room for STOP on top of every batch
+
+        Batch *batch = nullptr;
+        unsigned int current = 0;
+        size_t index = 0;
+        bool ended = false;
+
+        // handed to the lexing thread instead of a batch when the caller is done with it
+        static constexpr unsigned int STOP = ~0u;
+
+        std::thread worker;
+
+        void lex() {
+            Token t;
+            bool more = true;
+
+            while (more) {
+                unsigned int b;
+                emptied.pop(b);
+
+                if (b == STOP)
+                    return;
+
+                Batch &filling = batches[b];
+                filling.tokens.clear();
+                filling.strings.reset();
+
+                while (filling.tokens.size() < PIPELINE_BATCH_SIZE && (more = generator.next(t))) {
+                    if (copyStrings && (t.type == TokenType::IDENTIFIER || t.type == TokenType::MARKER
+                                        || t.type == TokenType::STRING || t.type == TokenType::DIRECTIVE)) {
+                        char *destination = filling.strings.allocate(t.valString.size());
+                        std::memcpy(destination, t.valString.data(), t.valString.size());
+                        t.valString = std::string_view(destination, t.valString.size());
+                    }
+
+                    filling.tokens.push_back(t);
+                }
+
+                filling.last = !more;
+                filled.push(b);
+            }
+        }
+
+        void start() {
+            for (unsigned int b = 0; b < PIPELINE_BATCHES; b++) {
+                batches[b].tokens.reserve(PIPELINE_BATCH_SIZE);
+                emptied.push(b);
+            }
+
+            worker = std::thread(&PipelinedLexer::lex, this);
+        }
+
+    public:
+        // state is written by the lexing thread, it is complete once next returned false
+        PipelinedLexer(std::string_view code, LexState &state, SymbolPool &_symbols)
+                : symbols(_symbols), generator(code, state, names), copyStrings(false), batches(PIPELINE_BATCHES),
+                  filled(PIPELINE_BATCHES), emptied(PIPELINE_BATCHES + 1) {
+            start();
+        }
+
+        PipelinedLexer(FILE *input, LexState &state, SymbolPool &_symbols)
+                : symbols(_symbols), generator(input, state, names), copyStrings(true), batches(PIPELINE_BATCHES),
+                  filled(PIPELINE_BATCHES), emptied(PIPELINE_BATCHES + 1) {
+            start();
+        }
+
+        // a lexing thread that is still waiting for a batch gets STOP instead, one that already lexed everything
+        // has returned and never looks at it
+        ~PipelinedLexer() {
+            emptied.push(STOP);
+            worker.join();
+        }
+
+        bool next(Token &t) {
+            while (!batch || index == batch->tokens.size()) {
+                if (batch) {
+                    ended = batch->last;
+                    emptied.push(current);
+                    batch = nullptr;
+                }
+
+                if (ended)
+                    return false;
+
+                filled.pop(current);
+                batch = &batches[current];
+                index = 0;
+            }
+
+            t = batch->tokens[index++];
+
+            if (t.type == TokenType::IDENTIFIER || t.type == TokenType::MARKER) {
+                t.valNumeric = symbols.intern(t.valString);
+                t.valString = symbols.name(t.valNumeric);
+            }
+
+            return true;
+        }
+    };
+
+    // hands out the tokens of a token store one at a time, so the batch pipeline can feed them to a pull stage
+    class TokenReader {
+    private:
+        const TokenStore &tokens;
+        const SymbolPool &symbols;
+        size_t index = 0;
+
+    public:
+        TokenReader(const TokenStore &_tokens, const SymbolPool &_symbols) : tokens(_tokens), symbols(_symbols) {}
+
+        bool next(Token &t) {
+            if (index == tokens.size())
+                return false;
+
+            t = tokens.at(index++, symbols);
+            return true;
+        }
+    };
+
+    // lexed files that %include pastes in place of the directive. every file is lexed once per process into an
+    // entry with its own pool and pasting it again only maps its names to the ids of the assembly, so a library
+    // included by many files or rebuilt in watch mode is never lexed twice. entries are found by path and kept
+    // while the modification time and size stay the same, or the contents still have the same crc32
+    class IncludeCache {
+    public:
+        struct Entry {
+            std::filesystem::file_time_type modified;
+            uintmax_t size = 0;
+            uint32_t hash = 0;
+            unsigned int generation = 0;
+
+            std::string content;                 // what the strings of the tokens point into
+            std::unique_ptr<SymbolPool> symbols; // the names of the tokens are ids into this pool
+            TokenStore tokens;
+            LexState state;
+        };
+
+    private:
+        std::unordered_map<std::string, Entry> entries;
+        unsigned int generation = 0;
+
+    public:
+        // files are checked for changes once per generation, so every include of an assembly sees the same
+        // contents and the tokens it got stay valid until it is done
+        void nextGeneration() {
+            ++generation;
+        }
+
+        // returns nullptr when the file can't be read
+        const Entry *load(const std::filesystem::path &path) {
+            std::error_code error;
+            Entry &entry = entries[path.string()];
+
+            if (entry.symbols && entry.generation == generation)
+                return &entry;
+
+            auto modified = std::filesystem::last_write_time(path, error);
+            uintmax_t size = error ? 0 : std::filesystem::file_size(path, error);
+            std::ifstream file(path, std::ios::binary);
+
+            if (error || !file.is_open()) {
+                entries.erase(path.string());
+                return nullptr;
+            }
+
+            entry.generation = generation;
+
+            if (entry.symbols && entry.modified == modified && entry.size == size)
+                return &entry;
+
+            std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+            uint32_t hash = crc32(content.data(), content.size());
+
+            entry.modified = modified;
+            entry.size = size;
+
+            // touched without being changed
+            if (entry.symbols && entry.hash == hash)
+                return &entry;
+
+            entry.hash = hash;
+            entry.content = std::move(content);
+            entry.symbols = std::make_unique<SymbolPool>();
+            entry.tokens.clear();
+            entry.state = LexState{};
+
+            lexChunk(entry.content, true, entry.state, *entry.symbols, [&entry](const Token &t) {
+                entry.tokens.push(t);
+            });
+
+            return &entry;
+        }
+    };
+
+    IncludeCache &includeCache() {
+        static IncludeCache cache;
+        return cache;
+    }
+
+    // pulls tokens from source with every %include "file" replaced by the tokens of the file, nested includes are
+    // resolved relative to the file they are in. %global directives are passed on
+    template <typename Source>
+    class IncludeFilter {
+    private:
+        // where an included file is being read from, with the ids its names have in the assembly
+        struct Cursor {
+            const IncludeCache::Entry *entry;
+            size_t index;
+            std::vector<uint32_t> ids;
+            int base; // of the locations the source map gave this paste of the file
+        };
+
+        Source &source;
+        SymbolPool &symbols;
+        std::vector<std::filesystem::path> files; // the file being expanded and the ones that included it
+        std::vector<Cursor> cursors;              // one for every file after the first
+
+        bool expectingPath = false;
+        int directiveLine = 0;
+
+        static constexpr uint32_t NO_ID = ~0u;
+
+        [[noreturn]] void includeError(const std::string &message, int lineFound) {
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " " << message << " on"
+                      << termcolor::red << " " << describeLine(lineFound) << termcolor::reset << "\n\n";
+            std::exit(-1);
+        }
+
+        void include(std::string_view name, int lineFound) {
+            std::filesystem::path path = std::filesystem::weakly_canonical(files.back().parent_path() / name);
+
+            if (std::find(files.begin(), files.end(), path) != files.end())
+                includeError("'" + std::string(name) + "' includes itself", lineFound);
+
+            const IncludeCache::Entry *entry = includeCache().load(path);
+
+            if (!entry)
+                includeError("Could not open included file '" + std::string(name) + "'", lineFound);
+
+            int base = sourceMap().add(path, entry->state.lineFound);
+
+            if (entry->state.error) {
+                LexState located = entry->state;
+
+                for (auto &d: located.diagnostics)
+                    d.lineFound = SourceMap::locate(base, d.lineFound);
+
+                abortOnLexErrors(located);
+            }
+
+            files.push_back(path);
+            cursors.push_back(Cursor{entry, 0, std::vector<uint32_t>(entry->symbols->size(), NO_ID), base});
+        }
+
+        // the next token of the innermost included file, false once it has none left
+        bool nextIncluded(Token &t) {
+            Cursor &cursor = cursors.back();
+
+            if (cursor.index == cursor.entry->tokens.size())
+                return false;
+
+            t = cursor.entry->tokens.at(cursor.index++, *cursor.entry->symbols);
+            t.lineFound = SourceMap::locate(cursor.base, t.lineFound);
+
+            // names are interned in the order they show up, like they would be if the file was pasted in
+            if (t.type == TokenType::IDENTIFIER || t.type == TokenType::MARKER) {
+                uint32_t &id = cursor.ids[t.valNumeric];
+
+                if (id == NO_ID)
+                    id = symbols.intern(cursor.entry->symbols->name(t.valNumeric));
+
+                t.valNumeric = id;
+                t.valString = symbols.name(id);
+            }
+
+            return true;
+        }
+
+    public:
+        // starts a new generation of the cache, so one filter is used per assembly
+        IncludeFilter(const std::string &fileName, SymbolPool &_symbols, Source &_source)
+                : source(_source), symbols(_symbols) {
+            // stdin includes relative to the working directory
+            std::filesystem::path path = fileName == "-" ? std::filesystem::current_path() / "-"
+                                                         : std::filesystem::path(fileName);
+            files.push_back(std::filesystem::weakly_canonical(path));
+
+            includeCache().nextGeneration();
+        }
+
+        bool next(Token &t) {
+            while (true) {
+                if (cursors.empty()) {
+                    if (!source.next(t))
+                        return false;
+                } else if (!nextIncluded(t)) {
+                    finish();
+                    cursors.pop_back();
+                    files.pop_back();
+                    continue;
+                }
+
+                if (expectingPath) {
+                    if (t.type != TokenType::STRING)
+                        includeError("Expected a file name after %include", directiveLine);
+
+                    expectingPath = false;
+                    include(t.valString, directiveLine);
+                    continue;
+                }
+
+                if (t.type == TokenType::DIRECTIVE) {
+                    // exports are declarations, they are left to the stages that handle those
+                    if (t.valString == "global")
+                        return true;
+
+                    if (t.valString != "include")
+                        includeError("Unknown directive '%" + std::string(t.valString) + "'", t.lineFound);
+
+                    expectingPath = true;
+                    directiveLine = t.lineFound;
+                    continue;
+                }
+
+                return true;
+            }
+        }
+
+        // reports a directive at the very end of a file
+        void finish() {
+            if (expectingPath)
+                includeError("Expected a file name after %include", directiveLine);
+        }
+    };
+
+    // replaces the include directives of a lexed file, files without any are left as they are
+    void expandIncludes(TokenStore &tokens, const std::string &fileName, SymbolPool &symbols) {
+        if (std::find(tokens.types.begin(), tokens.types.end(), TokenType::DIRECTIVE) == tokens.types.end())
+            return;
+
+        TokenStore expanded;
+        expanded.reserve(tokens.size());
+
+        TokenReader reader(tokens, symbols);
+        IncludeFilter<TokenReader> included(fileName, symbols, reader);
+        Token t;
+
+        while (included.next(t))
+            expanded.push(t);
+
+        included.finish();
+        tokens = std::move(expanded);
+    }
+
+    // takes the definitions, markers and exports out of the tokens pulled from source and hands them to
+    // declarations as they go by, only the tokens of instructions come out
+    template <typename Source, typename Declarations>
+    class DeclarationFilter {
+    private:
+        Source &source;
+        Declarations &declarations;
+
+        // a definition that was cut off by the end of the input, reported in finish
+        bool incomplete = false;
+        int definitionLine = 0;
+
+        [[noreturn]] void unknownDefinitionSyntax() {
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                      << " Unknown syntax in definition statement on" << termcolor::red << " "
+                      << describeLine(definitionLine) << termcolor::reset;
+            std::exit(-1);
+        }
+
+    public:
+        DeclarationFilter(Source &_source, Declarations &_declarations)
+                : source(_source), declarations(_declarations) {}
+
+        bool next(Token &t) {
+            while (source.next(t)) {
+                if (t.type == TokenType::MARKER) {
+                    declarations.mark(t.valNumeric, t.lineFound);
+                    continue;
+                }
+
+                // the include filter only lets %global through, it is followed by the name to export
+                if (t.type == TokenType::DIRECTIVE) {
+                    int line = t.lineFound;
+
+                    if (!source.next(t) || t.type != TokenType::IDENTIFIER)
+                        expectedGlobalName(line);
+
+                    declarations.exportSymbol(t.valNumeric, line);
+                    continue;
+                }
+
+                if (t.type != TokenType::IDENTIFIER || t.valNumeric != SymbolPool::DEF)
+                    return true;
+
+                // definitions are def <identifier> <string>
+                incomplete = true;
+                definitionLine = t.lineFound;
+
+                if (!source.next(t))
+                    return false;
+
+                if (t.type != TokenType::IDENTIFIER)
+                    unknownDefinitionSyntax();
+
+                uint32_t name = t.valNumeric;
+
+                if (!source.next(t))
+                    return false;
+
+                if (t.type != TokenType::STRING)
+                    unknownDefinitionSyntax();
+
+                declarations.define(name, t.valString, definitionLine);
+                incomplete = false;
+            }
+
+            return false;
+        }
+
+        void finish() {
+            if (incomplete)
+                unknownDefinitionSyntax();
+        }
+    };
+
+    // assembles tokens as they come in instead of collecting them first, only the names, strings and bytecode
+    // the output needs are kept. references to symbols that are already declared are encoded right away, forward
+    // references are written as zeroes and patched as soon as their marker shows up, or at the end for definitions
+    // since the data section is laid out last. reports the same errors as the batch pipeline. code can't be moved
+    // once written, so only the wide forms are final as they are encoded. executables without --wide keep the
+    // tokens of their instructions instead and lay them out in finish like the batch pipeline, so both modes
+    // write the same bytes. objects always encode right away, the linker needs 32 bit fields to move
+    class StreamAssembler {
+    private:
+        struct Fixup {
+            unsigned int offset;
+            unsigned int symbol;      // NO_SYMBOL once patched
+            int lineFound;
+            unsigned int next;        // next fixup waiting for the same symbol
+            unsigned int instruction; // pending instruction the reference is an operand of
+            unsigned int operand;
+        };
+
+        // an instruction with operands that are not declared yet, the opcode is only known once they are because
+        // markers and definitions select different encodings
+        struct PendingInstruction {
+            unsigned int opcodeOffset;
+            unsigned int sequence;
+            Token opcode;
+            unsigned int types; // where the operand types start in pendingTypes
+            unsigned int count;
+            unsigned int unresolved;
+        };
+
+        // a field holding the address of a symbol, object files list all of them so the linker can move the code.
+        // fields of symbols declared in the same file already hold their address within its sections
+        struct Relocation {
+            unsigned int offset;
+            uint32_t symbol;
+            unsigned int instruction; // pending instruction the reference was unresolved in, or NO_INSTRUCTION
+            unsigned int operand;
+        };
+
+        struct EncodingError {
+            unsigned int sequence;
+            Token opcode;
+            std::vector<TokenType> types;
+        };
+
+        // names and the strings that have to outlive the chunk they were lexed from
+        SymbolPool symbols;
+        SymbolTable table;
+        std::vector<Fixup> fixups;
+        std::vector<unsigned int> pendingFixups; // first fixup waiting for each symbol id
+        std::vector<std::pair<Symbol, Symbol>> duplicates; // the second one has no kind for reserved names
+
+        std::vector<PendingInstruction> pendingInstructions;
+        std::vector<TokenType> pendingTypes; // operand types of every pending instruction back to back
+        std::vector<EncodingError> encodingErrors;
+        unsigned int instructionCount = 0;
+
+        std::vector<Definition> definitions;
+        std::vector<Marker> markers;
+        std::vector<unsigned char> bytecode;
+        bool wide;
+
+        // the instructions of an executable without --wide, laid out in finish
+        bool relaxing;
+        TokenStore instructions;
+        std::vector<InstructionLayout> layout;
+        PassBuffers buffers;
+
+        // references that are still unresolved at the end are left to the linker
+        bool object;
+        std::vector<Relocation> relocations;
+        std::vector<std::pair<uint32_t, int>> exports; // names given to %global and the line they were on
+
+        // markers seen while an instruction was still taking arguments, they point at the one after it
+        std::vector<std::pair<Marker, bool>> pendingMarkers;
+
+        bool hasOpcode = false;
+        Token opcode;
+        TokenStore arguments;
+        std::vector<unsigned int> argumentSymbols;
+        std::vector<unsigned int> argumentReferences;
+        std::vector<unsigned int> argumentOffsets;
+
+        // first token that showed up before any opcode
+        bool hasStray = false;
+        Token stray;
+        unsigned int straySymbol;
+
+        static constexpr unsigned int NO_SYMBOL = ~0u;
+        static constexpr unsigned int NO_OFFSET = ~0u;
+        static constexpr unsigned int NO_FIXUP = ~0u;
+        static constexpr unsigned int NO_INSTRUCTION = ~0u;
+        static constexpr int NO_ADDRESS = -1;
+
+        std::string_view keep(std::string_view value) {
+            char *destination = symbols.allocate(value.size());
+            std::memcpy(destination, value.data(), value.size());
+
+            return std::string_view(destination, value.size());
+        }
+
+        void patch(unsigned int offset, int value) {
+            for (int i = 0; i < 4; i++)
+                bytecode[offset + i] = (value >> (24 - 8 * i)) & 0xFF;
+        }
+
+        // remembers a reference to a symbol that has not been declared yet
+        void addFixup(unsigned int offset, unsigned int symbol, int lineFound,
+                      unsigned int instruction = NO_INSTRUCTION, unsigned int operand = 0) {
+            if (pendingFixups.size() <= symbol)
+                pendingFixups.resize(symbols.size(), NO_FIXUP);
+
+            fixups.push_back(Fixup{offset, symbol, lineFound, pendingFixups[symbol], instruction, operand});
+            pendingFixups[symbol] = fixups.size() - 1;
+        }
 
-        // Section Seperation Sequence
-        char a = 254;
-        
+        // picks the opcode of a pending instruction once the last of its operands is declared
+        void resolveOperand(unsigned int instruction, unsigned int operand, TokenType type) {
+            PendingInstruction &pending = pendingInstructions[instruction];
+            const TokenType *types = pendingTypes.data() + pending.types;
+            pendingTypes[pending.types + operand] = type;
 
-        std::ofstream file;
-        file.open(fileName, std::ios::binary);
+            if (--pending.unresolved > 0)
+                return;
 
-        for (int i = 0; i < definitions.size(); i++) {
-            std::string s = definitions[i].value;
+            Encoding encoding = findEncoding(pending.opcode.valNumeric, types, pending.count);
 
-            s = replace(s, "\\n", "\n");
-            s = replace(s, "\\t", "\t");
-            s = replace(s, "\\\\", "\\");
-            s = replace(s, "\\'", "'");
-            s = replace(s, "\\\"", "\"");
-            s = replace(s, "\\a", "\a");
-            s = replace(s, "\\b", "\b");
-            s = replace(s, "\\e", "\e");
-            s = replace(s, "\\f", "\f");
-            s = replace(s, "\\r", "\r");
-            s = replace(s, "\\v", "\v");
+            if (encoding.valid) {
+                bytecode[pending.opcodeOffset] = encoding.opcode;
+            } else {
+                encodingErrors.push_back(EncodingError{pending.sequence, pending.opcode,
+                                                       std::vector<TokenType>(types, types + pending.count)});
+            }
+        }
 
-            if (s != "") {
-                file.write(s.c_str(), s.size());
+        // adds a marker or definition to the table, returns false when the name was already taken or belongs to
+        // a mnemonic or register
+        bool declare(const Symbol &symbol) {
+            // reported in finish, after the lexer had its chance to report errors, like the batch pipeline does
+            if (isReservedName(symbols.name(symbol.name))) {
+                duplicates.emplace_back(symbol, Symbol{symbol.name, SymbolKind::NONE, NO_ADDRESS, 0});
+                return false;
             }
+
+            const Symbol *existing = table.insert(symbol);
+
+            if (existing)
+                duplicates.emplace_back(symbol, *existing);
+
+            return !existing;
         }
 
-        char bytecodeHeader[] = {(char)0xDE, (char)0xAD, (char)0xBE, (char)0xEF, CCBC_VERSION};
+        // a declared symbol with a known address, markers in front of an instruction that is still collecting
+        // arguments are declared but don't have one yet
+        const Symbol *lookup(uint32_t name) {
+            const Symbol *symbol = table.find(name);
+            return symbol && symbol->address != NO_ADDRESS ? symbol : nullptr;
+        }
 
-        file.write(bytecodeHeader, 8);
+        // patches every reference that was waiting for the symbol
+        void resolve(const Symbol &symbol) {
+            if (symbol.name >= pendingFixups.size())
+                return;
 
-        std::string s(bytecode.begin(), bytecode.end());
-        file.write(s.c_str(), s.size());
+            for (unsigned int i = pendingFixups[symbol.name]; i != NO_FIXUP; i = fixups[i].next) {
+                if (fixups[i].offset != NO_OFFSET)
+                    patch(fixups[i].offset, symbol.address);
 
-        file.close();
-    }
+                if (fixups[i].instruction != NO_INSTRUCTION)
+                    resolveOperand(fixups[i].instruction, fixups[i].operand, symbolType(symbol.kind));
 
-    void assemble(std::string fileName, cxxopts::ParseResult result) {
-        auto begin = std::chrono::high_resolution_clock::now();
+                fixups[i].symbol = NO_SYMBOL;
+            }
 
-        uint8_t silent = result.count("silent");
-        uint8_t customOutName = 0;
+            pendingFixups[symbol.name] = NO_FIXUP;
+        }
 
-        std::string outputName = "";
+        // gives a marker the address of the next instruction, declared is false for duplicates
+        void placeMarker(Marker m, bool declared) {
+            m.instruction = instructionCount;
+            m.byteIndex = bytecode.size();
+            markers.push_back(m);
 
-        if (result.count("output")) {
-            customOutName = 1;
-            outputName = result["output"].as<std::string>();
+            if (!declared)
+                return;
+
+            Symbol *symbol = table.find(m.name);
+            symbol->address = m.byteIndex;
+            resolve(*symbol);
         }
 
-        if (!silent) {
-            std::cout << termcolor::green << "[INFO]" << termcolor::reset << " Parsing " << termcolor::green << fileName
-                      << termcolor::reset << "...\n\n";
+        // whether the current instruction has an encoding for some kind of symbol behind each of its unresolved
+        // operands. when it has none, no other object can declare them in a way the linker could encode
+        bool encodableOnceResolved() const {
+            if (arguments.size() > MAX_OPERANDS)
+                return false;
+
+            const SymbolKind kinds[] = {SymbolKind::MARKER, SymbolKind::DEFINITION};
+            TokenType types[MAX_OPERANDS];
+
+            for (unsigned int choice = 0; choice < 1u << arguments.size(); choice++) {
+                for (unsigned int i = 0; i < arguments.size(); i++) {
+                    types[i] = argumentSymbols[i] == NO_SYMBOL ? arguments.types[i]
+                                                               : symbolType(kinds[choice >> i & 1]);
+                }
+
+                if (findEncoding(opcode.valNumeric, types, arguments.size()).valid)
+                    return true;
+            }
+
+            return false;
         }
 
-        // read inputs
-        if (!customOutName) {
-            outputName = fileName.substr(0, fileName.find(".")) + ".ccb";
+        // encodes a branch to a marker that is already declared in the smallest form that reaches it
+        bool encodeBackwardBranch() {
+            if (wide || !isShortBranch(opcode.valNumeric, arguments.types.data(), arguments.size())
+                || argumentSymbols[0] != NO_SYMBOL)
+                return false;
+
+            for (BranchForm form: {BranchForm::REL8, BranchForm::REL16}) {
+                int displacement = (int) arguments.values[0] - (int) (bytecode.size() + branchSize(form));
+
+                if (smallestBranchForm(displacement) <= form) {
+                    encodeShortBranch(bytecode, opcode.valNumeric, form, displacement);
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        // encodes the instruction that has been collecting arguments
+        void encodeCurrent() {
+            unsigned int unresolved = 0;
+            bool relocated = false;
+
+            if (object) {
+                argumentReferences = argumentSymbols;
+                relocated = std::any_of(argumentSymbols.begin(), argumentSymbols.end(),
+                                        [](unsigned int symbol) { return symbol != NO_SYMBOL; });
+            }
+
+            // references to symbols that are already declared are encoded like any other operand
+            for (unsigned int i = 0; i < arguments.size(); i++) {
+                if (argumentSymbols[i] == NO_SYMBOL)
+                    continue;
+
+                const Symbol *symbol = lookup(argumentSymbols[i]);
+
+                if (symbol) {
+                    arguments.types[i] = symbolType(symbol->kind);
+                    arguments.values[i] = symbol->address;
+                    argumentSymbols[i] = NO_SYMBOL;
+                } else {
+                    ++unresolved;
+                }
+            }
+
+            unsigned int opcodeOffset = bytecode.size();
+            unsigned int sequence = instructionCount++;
+
+            if (encodeBackwardBranch())
+                return;
+
+            // forward references are patched in place and the linker moves every address in an object, so they need
+            // the 32 bit form
+            bool valid = encodeInstruction(bytecode, opcode.valNumeric, arguments.types.data(), arguments.values.data(),
+                                           arguments.size(), wide || unresolved > 0 || relocated, &argumentOffsets);
+
+            if (unresolved == 0) {
+                if (!valid)
+                    encodingErrors.push_back(EncodingError{sequence, opcode, arguments.types});
+            } else if (object && !encodableOnceResolved()) {
+                // references that may be left to the linker are reported as the identifiers they still are
+                std::vector<TokenType> types = arguments.types;
+
+                for (unsigned int i = 0; i < arguments.size(); i++) {
+                    if (argumentSymbols[i] != NO_SYMBOL)
+                        types[i] = TokenType::IDENTIFIER;
+                }
+
+                encodingErrors.push_back(EncodingError{sequence, opcode, types});
+                return;
+            } else {
+                pendingInstructions.push_back(PendingInstruction{opcodeOffset, sequence, opcode,
+                                                                 (unsigned int) pendingTypes.size(),
+                                                                 (unsigned int) arguments.size(), unresolved});
+                pendingTypes.insert(pendingTypes.end(), arguments.types.begin(), arguments.types.end());
+
+                for (unsigned int i = 0; i < arguments.size(); i++) {
+                    if (argumentSymbols[i] != NO_SYMBOL) {
+                        addFixup(argumentOffsets[i], argumentSymbols[i], arguments.lines[i],
+                                 pendingInstructions.size() - 1, i);
+                    }
+                }
+            }
+
+            if (!object)
+                return;
+
+            for (unsigned int i = 0; i < arguments.size(); i++) {
+                if (argumentReferences[i] == NO_SYMBOL)
+                    continue;
+
+                unsigned int instruction = argumentSymbols[i] != NO_SYMBOL ? pendingInstructions.size() - 1
+                                                                            : NO_INSTRUCTION;
+                relocations.push_back(Relocation{argumentOffsets[i], argumentReferences[i], instruction, i});
+            }
+        }
+
+        // amount of records, then per record the offset of the field (4 bytes) and the kind of symbol it holds
+        // the address of (1 byte). a marker or definition of the same file is already in the field, relative to the
+        // start of its section, the linker only moves it. the others are looked up by name, their records go on with
+        // the offset of the opcode (4 bytes, all ones when the opcode is final), the mnemonic, the amount of operands,
+        // which one the field is and the operand types (1 byte each), the name length (2 bytes) and the name
+        std::vector<char> relocationSection() {
+            std::vector<char> section;
+            pushBigEndian(section, relocations.size(), 4);
+
+            for (auto &r: relocations) {
+                const Symbol *local = lookup(r.symbol);
+                pushBigEndian(section, r.offset, 4);
+
+                if (local) {
+                    section.push_back(static_cast<char>(local->kind));
+                    continue;
+                }
+
+                section.push_back(static_cast<char>(SymbolKind::NONE));
+
+                std::string_view name = symbols.name(r.symbol);
+                const PendingInstruction *pending = nullptr;
+
+                // instructions of which every operand showed up later in the same file already have their opcode
+                if (r.instruction != NO_INSTRUCTION && pendingInstructions[r.instruction].unresolved > 0)
+                    pending = &pendingInstructions[r.instruction];
+
+                pushBigEndian(section, pending ? pending->opcodeOffset : NO_OFFSET, 4);
+                pushBigEndian(section, pending ? pending->opcode.valNumeric : 0, 1);
+                pushBigEndian(section, pending ? pending->count : 0, 1);
+                pushBigEndian(section, r.operand, 1);
+
+                for (unsigned int i = 0; i < MAX_OPERANDS; i++) {
+                    bool known = pending && i < pending->count;
+                    pushBigEndian(section, known ? static_cast<unsigned int>(pendingTypes[pending->types + i]) : 0, 1);
+                }
+
+                pushBigEndian(section, name.size(), 2);
+                section.insert(section.end(), name.begin(), name.end());
+            }
+
+            return section;
+        }
+
+        void flushInstruction() {
+            if (!hasOpcode)
+                return;
+
+            encodeCurrent();
+
+            arguments.clear();
+            argumentSymbols.clear();
+            hasOpcode = false;
+
+            for (auto &m: pendingMarkers)
+                placeMarker(m.first, m.second);
+
+            pendingMarkers.clear();
+        }
+
+    public:
+        // an object keeps unresolved references for the linker and lists every address it contains
+        explicit StreamAssembler(bool _wide = false, bool _object = false)
+                : wide(_wide), relaxing(!_wide && !_object), object(_object) {}
+
+        // forgets the previous assembly but keeps the memory it used, so watch mode can assemble again without
+        // going back to the allocator
+        void reset(bool _wide, bool _object) {
+            symbols.clear();
+            table.clear();
+            fixups.clear();
+            pendingFixups.clear();
+            duplicates.clear();
+
+            pendingInstructions.clear();
+            pendingTypes.clear();
+            encodingErrors.clear();
+            instructionCount = 0;
+
+            definitions.clear();
+            markers.clear();
+            bytecode.clear();
+            wide = _wide;
+            relaxing = !_wide && !_object;
+            instructions.clear();
+            layout.clear();
+            object = _object;
+            relocations.clear();
+            exports.clear();
+
+            pendingMarkers.clear();
+            hasOpcode = false;
+            arguments.clear();
+            argumentSymbols.clear();
+            argumentReferences.clear();
+            argumentOffsets.clear();
+            hasStray = false;
+        }
+
+        // the address is only known once the whole data section is, so every reference to a definition is a forward
+        // one
+        void define(uint32_t name, std::string_view value, int lineFound) {
+            definitions.push_back(Definition{0, keep(value), name, lineFound});
+            declare(Symbol{name, SymbolKind::DEFINITION, NO_ADDRESS, lineFound});
+        }
+
+        // markers are declared right away so duplicates are found in source order, but the address is only known
+        // once the current instruction is encoded
+        void mark(uint32_t name, int lineFound) {
+            Marker m{name, 0, 0, lineFound};
+            bool declared = declare(Symbol{name, SymbolKind::MARKER, NO_ADDRESS, lineFound});
+
+            // like in the batch pipeline the marker points at the next instruction until the layout
+            if (relaxing) {
+                m.instruction = instructionCount;
+                markers.push_back(m);
+
+                if (declared)
+                    table.find(name)->address = instructionCount;
+
+                return;
+            }
+
+            if (hasOpcode)
+                pendingMarkers.emplace_back(m, declared);
+            else
+                placeMarker(m, declared);
+        }
+
+        // lets other objects use the marker or definition, it has to be declared somewhere in the same file
+        void exportSymbol(uint32_t name, int lineFound) {
+            exports.emplace_back(name, lineFound);
+        }
+
+        // pulls every token source has, a DeclarationFilter in front of it passes on the definitions and markers
+        template <typename Source>
+        void consume(Source &source) {
+            Token t;
+
+            while (source.next(t))
+                push(t);
         }
 
-        // tokenise
-        std::vector<Token> tokens = lexer(readFile(fileName));
+        // takes the tokens of instructions, definitions and markers go to define and mark
+        void push(Token t) {
+            unsigned int argumentSymbol = NO_SYMBOL;
 
-        std::vector<Marker> markers = {};
+            // dividers only separate arguments
+            if (t.type == TokenType::DIVIDER)
+                return;
+
+            // references stay identifiers until finish resolves them like postTokenizer does
+            if (relaxing) {
+                if (t.type == TokenType::IDENTIFIER)
+                    classifyKeyword(t);
+                else if (t.type == TokenType::STRING)
+                    t.valString = keep(t.valString);
+
+                instructionCount += t.type == TokenType::OPCODE;
+                instructions.push(t);
+                return;
+            }
+
+            // identifiers already point into the pool and classifying swaps the views of opcodes and registers for
+            // static names, so all of them survive the chunk. references are resolved when the instruction is
+            // flushed, until then they are numbers
+            if (t.type == TokenType::IDENTIFIER && !classifyKeyword(t)) {
+                argumentSymbol = t.valNumeric;
+                t.type = TokenType::NUMBER;
+            } else if (t.type == TokenType::STRING) {
+                t.valString = keep(t.valString);
+            }
+
+            if (t.type == TokenType::OPCODE) {
+                flushInstruction();
+                opcode = t;
+                hasOpcode = true;
+                return;
+            }
+
+            // like the batch pipeline, a missing opcode is only reported once the references have been checked
+            if (!hasOpcode) {
+                if (argumentSymbol != NO_SYMBOL && !lookup(argumentSymbol))
+                    addFixup(NO_OFFSET, argumentSymbol, t.lineFound);
+
+                if (!hasStray) {
+                    stray = t;
+                    straySymbol = argumentSymbol;
+                    hasStray = true;
+                }
+
+                return;
+            }
+
+            arguments.push(t);
+            argumentSymbols.push_back(argumentSymbol);
+        }
+
+        // encodes the last instruction and reports whatever is still unresolved, exits when there were errors
+        void finish() {
+            flushInstruction();
+
+            layoutData(definitions);
+
+            for (auto &d: definitions) {
+                Symbol *symbol = table.find(d.name);
+
+                // duplicates keep the address of the first declaration, reserved names were never declared
+                if (symbol && symbol->kind == SymbolKind::DEFINITION && symbol->address == NO_ADDRESS) {
+                    symbol->address = d.index;
+                    resolve(*symbol);
+                }
+            }
+
+            bool errors = !duplicates.empty();
+
+            for (auto &duplicate: duplicates) {
+                if (duplicate.second.kind == SymbolKind::NONE)
+                    reportReservedName(duplicate.first, symbols);
+                else
+                    reportDuplicate(duplicate.first, duplicate.second, symbols);
+            }
+
+            if (relaxing)
+                errors |= !resolveIdentifiers(instructions, table, symbols);
+
+            for (auto &f: fixups) {
+                if (f.symbol == NO_SYMBOL || (object && f.offset != NO_OFFSET))
+                    continue;
+
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not match identifier '"
+                          << symbols.name(f.symbol) << "' on" << termcolor::red << " " << describeLine(f.lineFound)
+                          << termcolor::reset << "\n\n";
+                errors = true;
+            }
+
+            // executables have nothing to export to, only objects check the names
+            for (auto &e: exports) {
+                if (!object || table.find(e.first))
+                    continue;
+
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Could not match identifier '"
+                          << symbols.name(e.first) << "' on" << termcolor::red << " " << describeLine(e.second)
+                          << termcolor::reset << "\n\n";
+                errors = true;
+            }
+
+            if (errors) {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                          << " Aborting due to errors while analyzing semantics\n\n";
+                std::exit(-1);
+            }
+
+            if (relaxing) {
+                layoutInstructions(instructions, markers, false, layout, 1, buffers);
+                generateBytecode(instructions, layout, false, symbols, bytecode, 1, buffers);
+            }
+        }
+
+        // reports the errors generateBytecode would have found in the same order, or writes the executable
+        void write(const std::string &fileName, const ImageOptions &options) {
+            if (hasStray) {
+                if (straySymbol != NO_SYMBOL) {
+                    const Symbol *symbol = table.find(straySymbol);
+                    stray.type = symbolType(symbol->kind);
+                    stray.valNumeric = symbol->address;
+                }
+
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Expected opcode on "
+                          << describeLine(stray.lineFound) << " got " << stringifyToken(stray.type) << ": "
+                          << stringifyTokenValue(stray) << "\n";
+                std::exit(-1);
+            }
+
+            if (!encodingErrors.empty()) {
+                // instructions waiting for a forward reference are only checked once it shows up
+                std::sort(encodingErrors.begin(), encodingErrors.end(),
+                          [](const EncodingError &a, const EncodingError &b) {
+                              return a.sequence < b.sequence;
+                          });
+
+                for (auto &e: encodingErrors)
+                    reportUnknownEncoding(e.opcode.valNumeric, e.opcode.lineFound, e.types);
+
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                          << " Aborting due to errors while generating executable\n\n";
+                std::exit(-1);
+            }
+
+            if (!object) {
+                writeImage(definitions, markers, symbols, bytecode, fileName, options);
+                return;
+            }
+
+            // only the exported symbols are listed, the references to the others were resolved in place
+            std::vector<Definition> exportedDefinitions;
+            std::vector<Marker> exportedMarkers;
+            std::vector<bool> exported(symbols.size(), false);
+
+            for (auto &e: exports) {
+                const Symbol *symbol = table.find(e.first);
+
+                if (exported[e.first])
+                    continue;
+
+                exported[e.first] = true;
+
+                if (symbol->kind == SymbolKind::MARKER)
+                    exportedMarkers.push_back(Marker{e.first, 0, symbol->address, symbol->lineFound});
+                else
+                    exportedDefinitions.push_back(Definition{symbol->address, {}, e.first, symbol->lineFound});
+            }
+
+            std::vector<char> data = dataSection(definitions);
+            std::vector<char> symbolData = symbolSection(exportedDefinitions, exportedMarkers, symbols);
+            std::vector<char> relocationData = relocationSection();
+
+            writeContainer(fileName, {
+                    {SectionKind::DATA, 0, {data.data(), data.size()}},
+                    {SectionKind::CODE, 0, {bytecode.data(), bytecode.size()}},
+                    {SectionKind::SYMBOLS, 0, {symbolData.data(), symbolData.size()}},
+                    {SectionKind::RELOCATIONS, 0, {relocationData.data(), relocationData.size()}}
+            }, options.compress);
+        }
+
+        std::vector<Definition> &getDefinitions() {
+            return definitions;
+        }
+
+        std::vector<unsigned char> &getBytecode() {
+            return bytecode;
+        }
+
+        std::vector<Marker> &getMarkers() {
+            return markers;
+        }
+
+        SymbolPool &getSymbols() {
+            return symbols;
+        }
+    };
+
+    // everything an assembly keeps until it is written out. watch mode holds on to one between rebuilds, the
+    // containers are only cleared so after the first build they already have the capacity the next one needs
+    struct Workspace {
+        SymbolPool symbols;
+        TokenStore tokens;
+        std::vector<LexedChunk> chunks; // cleared by the lexer as it reuses them
+        SymbolTable table;              // cleared by postTokenizer
+        std::vector<Definition> definitions;
+        std::vector<Marker> markers;
+        std::vector<InstructionLayout> instructions;
+        std::vector<unsigned char> bytecode;
+        PassBuffers buffers;
+
+        StreamAssembler assembler;
+
+        void reset(bool wide, bool object) {
+            symbols.clear();
+            tokens.clear();
+            definitions.clear();
+            markers.clear();
+            instructions.clear();
+            bytecode.clear();
+            assembler.reset(wide, object);
+        }
+    };
+
+    // assembles while lexing, without ever collecting the tokens. used for --single-pass, for object files and
+    // for whatever is piped into stdin when the file name is -. the assembler pulls every token through the
+    // include and declaration filters straight from the lexer, one window of source at a time. with --pipeline the
+    // lexer runs ahead on a thread of its own
+    void assembleSinglePass(const std::string &fileName, const std::string &outputName, cxxopts::ParseResult &result,
+                            Workspace &workspace) {
+        StreamAssembler &assembler = workspace.assembler;
+        LexState state;
+
+        auto run = [&](auto &lexed) {
+            using Lexer = std::remove_reference_t<decltype(lexed)>;
+            IncludeFilter<Lexer> included(fileName, assembler.getSymbols(), lexed);
+            DeclarationFilter<IncludeFilter<Lexer>, StreamAssembler> declared(included, assembler);
+
+            assembler.consume(declared);
+
+            abortOnLexErrors(state);
+            included.finish();
+            declared.finish();
+        };
+
+        bool pipelined = result.count("pipeline");
+
+        if (fileName == "-" && pipelined) {
+            PipelinedLexer lexed(stdin, state, assembler.getSymbols());
+            run(lexed);
+        } else if (fileName == "-") {
+            TokenGenerator lexed(stdin, state, assembler.getSymbols());
+            run(lexed);
+        } else {
+            SourceFile source(fileName);
+
+            if (pipelined) {
+                PipelinedLexer lexed(source.view(), state, assembler.getSymbols());
+                run(lexed);
+            } else {
+                TokenGenerator lexed(source.view(), state, assembler.getSymbols());
+                run(lexed);
+            }
+        }
+
+        assembler.finish();
+
+        if (!result.count("silent")) {
+            std::cout << termcolor::green << "[INFO]" << termcolor::reset << " Generating " << termcolor::green
+                      << outputName << termcolor::reset << "...\n\n";
+        }
+
+        if (result.count("debug")) {
+            // the tokens are never collected when streaming, so there is nothing to print for them
+            std::cout << termcolor::blue << "[DEBUG]" << termcolor::reset << " Definitions found: \n";
+            printDefs(assembler.getDefinitions(), assembler.getSymbols());
+            std::cout << "\n";
+
+            std::cout << termcolor::blue << "[DEBUG]" << termcolor::reset << " Markers found: \n";
+            printMarkers(assembler.getMarkers(), assembler.getSymbols());
+            std::cout << "\n";
+        }
+
+        assembler.write(outputName, imageOptions(result));
+    }
+
+    // assembles a source file in separate passes over the complete token vector
+    void assembleFile(const std::string &fileName, const std::string &outputName, cxxopts::ParseResult &result,
+                      Workspace &workspace) {
+        uint8_t silent = result.count("silent");
+        bool wide = result.count("wide");
+        unsigned int jobs = result["jobs"].as<unsigned int>();
+
+        SymbolPool &symbols = workspace.symbols;
+        TokenStore &tokens = workspace.tokens;
+        std::vector<Marker> &markers = workspace.markers;
+        std::vector<Definition> &definitions = workspace.definitions;
+        std::vector<InstructionLayout> &instructions = workspace.instructions;
+        std::vector<unsigned char> &bytecode = workspace.bytecode;
+
+        // tokenise, the tokens point into the mapped source so it has to stay alive until the end
+        SourceFile source(fileName);
+        lexer(source.view(), symbols, tokens, jobs, workspace.chunks, workspace.buffers);
+        expandIncludes(tokens, fileName, symbols);
 
         // filter out the definitions
-        std::vector<Definition> definitions = parseDefinitions(tokens);
+        parseDefinitions(tokens, definitions);
 
         // post tokenizer
-        postTokenizer(tokens, markers, definitions);
+        postTokenizer(tokens, markers, definitions, symbols, workspace.table, workspace.buffers);
 
         if (!silent) {
             std::cout << termcolor::green << "[INFO]" << termcolor::reset << " Generating " << termcolor::green
                       << outputName << termcolor::reset << "...\n\n";
         }
 
+        layoutInstructions(tokens, markers, wide, instructions, jobs, workspace.buffers);
+
         if (result.count("debug")) {
             // print the tokens for debug
             std::cout << termcolor::blue << "[DEBUG]" << termcolor::reset << " Lexical analyzer result: \n";
-            printTokens(tokens);
+            printTokens(tokens, symbols);
             std::cout << "\n";
 
             // print the definitions for debug
             std::cout << termcolor::blue << "[DEBUG]" << termcolor::reset << " Definitions found: \n";
-            printDefs(definitions);
+            printDefs(definitions, symbols);
             std::cout << "\n";
 
             // print the markers
             std::cout << termcolor::blue << "[DEBUG]" << termcolor::reset << " Markers found: \n";
-            printMarkers(markers);
+            printMarkers(markers, symbols);
             std::cout << "\n";
         }
 
-        generateBytecode(definitions, tokens, outputName);
+        generateBytecode(tokens, instructions, wide, symbols, bytecode, jobs, workspace.buffers);
+        writeImage(definitions, markers, symbols, bytecode, outputName, imageOptions(result));
+    }
+
+    void assemble(std::string fileName, cxxopts::ParseResult result, Workspace &workspace) {
+        auto begin = std::chrono::high_resolution_clock::now();
+
+        uint8_t silent = result.count("silent");
+        uint8_t customOutName = 0;
+
+        std::string outputName = "";
+
+        if (result.count("output")) {
+            customOutName = 1;
+            outputName = result["output"].as<std::string>();
+        }
+
+        bool streaming = fileName == "-";
+        std::string displayName = streaming ? "<stdin>" : fileName;
+
+        if (!silent) {
+            std::cout << termcolor::green << "[INFO]" << termcolor::reset << " Parsing " << termcolor::green
+                      << displayName << termcolor::reset << "...\n\n";
+        }
+
+        // read inputs
+        if (!customOutName) {
+            std::string extension = result.count("compile") ? ".cco" : ".ccb";
+            outputName = (streaming ? "a" : fileName.substr(0, fileName.find("."))) + extension;
+        }
+
+        workspace.reset(result.count("wide"), result.count("compile"));
+        sourceMap().reset(fileName);
+
+        if (streaming || result.count("single-pass") || result.count("compile") || result.count("pipeline")) {
+            assembleSinglePass(fileName, outputName, result, workspace);
+        } else {
+            assembleFile(fileName, outputName, result, workspace);
+        }
 
         auto end = std::chrono::high_resolution_clock::now();
 
         if (!silent) {
             std::cout << termcolor::green << "[INFO]" << termcolor::reset << " Successfully assembled "
-                      << termcolor::green << fileName << termcolor::reset << ", took " << termcolor::green
+                      << termcolor::green << displayName << termcolor::reset << ", took " << termcolor::green
                       << std::chrono::duration<double, std::milli>(end - begin).count() << termcolor::reset << "ms\n\n";
         }
+    }
 
-        return;
+    void assemble(std::string fileName, cxxopts::ParseResult result) {
+        Workspace workspace;
+        assemble(fileName, result, workspace);
     }
 
     class AssemblerListener : public FW::FileWatchListener {
@@ -867,17 +4153,24 @@ namespace CCA {
 
         cxxopts::ParseResult result;
 
+        // kept between rebuilds so they reuse the memory of the previous one
+        Workspace workspace;
+
     public:
         AssemblerListener(std::string _fileName, cxxopts::ParseResult _result) {
             fileName = _fileName;
             result = _result;
         }
 
+        void assembleNow() {
+            assemble(fileName, result, workspace);
+        }
+
         void handleFileAction(FW::WatchID watchid, const FW::String &dir, const FW::String &filename,
                               FW::Action action) {
             switch (action) {
                 case FW::Actions::Modified:
-                    assemble(fileName, result);
+                    assemble(fileName, result, workspace);
             }
         }
     };
@@ -889,7 +4182,7 @@ namespace CCA {
 
         FW::WatchID watchid = fileWatcher.addWatch(fileName, &listener);
 
-        assemble(fileName, result);
+        listener.assembleNow();
 
         while (true) {
             fileWatcher.update();
@@ -0,0 +1,233 @@
+#pragma once
+
+// table driven recognizer for the lexer, the character classes and the transition table are both computed at
+// compile time from the rules below, so supporting a new kind of token only means adding states and rules
+
+#include <cstddef>
+
+namespace CCA {
+    namespace Lex {
+        enum State : unsigned char {
+            STOP, // no transition, the token ends before the current character
+            START,
+            BLANK,
+            IDENTIFIER,
+            MARKER,
+            MARKER_NAME,
+            DIVIDER,
+            STRING,
+            COMMENT,
+            NUMBER_ZERO,
+            NUMBER_DEC,
+            NUMBER_HEX_PREFIX,
+            NUMBER_HEX,
+            NUMBER_BIN_PREFIX,
+            NUMBER_BIN,
+            NUMBER_OCT_PREFIX,
+            NUMBER_OCT,
+            ADDRESS,
+            ADDRESS_ZERO,
+            ADDRESS_DEC,
+            ADDRESS_HEX_PREFIX,
+            ADDRESS_HEX,
+            ADDRESS_BIN_PREFIX,
+            ADDRESS_BIN,
+            ADDRESS_OCT_PREFIX,
+            ADDRESS_OCT,
+            DIRECTIVE,
+            DIRECTIVE_NAME,
+            STATE_COUNT
+        };
+
+        // what the lexer should do with the text matched when the automaton stops in a given state
+        enum class Accept : unsigned char {
+            NONE,
+            BLANK,
+            IDENTIFIER,
+            MARKER,
+            DIVIDER,
+            STRING,
+            COMMENT,
+            NUMBER,
+            ADDRESS,
+            DIRECTIVE,
+            MALFORMED_NUMBER
+        };
+
+        struct StateInfo {
+            Accept accept;
+            unsigned char base;   // base of numeric literals
+            unsigned char prefix; // amount of characters before the payload, e.g. ':' or '&0x'
+        };
+
+        struct Rule {
+            State from;
+            const char *characters;
+            State to;
+        };
+
+#define CCA_LEX_LETTERS "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_"
+#define CCA_LEX_DIGITS "0123456789"
+
+        constexpr StateInfo states[STATE_COUNT] = {
+                {Accept::NONE, 0, 0},              // STOP
+                {Accept::NONE, 0, 0},              // START
+                {Accept::BLANK, 0, 0},             // BLANK
+                {Accept::IDENTIFIER, 0, 0},        // IDENTIFIER
+                {Accept::MARKER, 0, 1},            // MARKER
+                {Accept::MARKER, 0, 1},            // MARKER_NAME
+                {Accept::DIVIDER, 0, 0},           // DIVIDER
+                {Accept::STRING, 0, 1},            // STRING
+                {Accept::COMMENT, 0, 1},           // COMMENT
+                {Accept::NUMBER, 10, 0},           // NUMBER_ZERO
+                {Accept::NUMBER, 10, 0},           // NUMBER_DEC
+                {Accept::MALFORMED_NUMBER, 16, 2}, // NUMBER_HEX_PREFIX
+                {Accept::NUMBER, 16, 2},           // NUMBER_HEX
+                {Accept::MALFORMED_NUMBER, 2, 2},  // NUMBER_BIN_PREFIX
+                {Accept::NUMBER, 2, 2},            // NUMBER_BIN
+                {Accept::MALFORMED_NUMBER, 8, 2},  // NUMBER_OCT_PREFIX
+                {Accept::NUMBER, 8, 2},            // NUMBER_OCT
+                {Accept::MALFORMED_NUMBER, 10, 1}, // ADDRESS
+                {Accept::ADDRESS, 10, 1},          // ADDRESS_ZERO
+                {Accept::ADDRESS, 10, 1},          // ADDRESS_DEC
+                {Accept::MALFORMED_NUMBER, 16, 3}, // ADDRESS_HEX_PREFIX
+                {Accept::ADDRESS, 16, 3},          // ADDRESS_HEX
+                {Accept::MALFORMED_NUMBER, 2, 3},  // ADDRESS_BIN_PREFIX
+                {Accept::ADDRESS, 2, 3},           // ADDRESS_BIN
+                {Accept::MALFORMED_NUMBER, 8, 3},  // ADDRESS_OCT_PREFIX
+                {Accept::ADDRESS, 8, 3},           // ADDRESS_OCT
+                {Accept::NONE, 0, 0},              // DIRECTIVE
+                {Accept::DIRECTIVE, 0, 1},         // DIRECTIVE_NAME
+        };
+
+        constexpr Rule rules[] = {
+                {START, " \t\r\n", BLANK},
+
+                {START, CCA_LEX_LETTERS, IDENTIFIER},
+                {IDENTIFIER, CCA_LEX_LETTERS CCA_LEX_DIGITS, IDENTIFIER},
+
+                {START, ":", MARKER},
+                {MARKER, CCA_LEX_LETTERS, MARKER_NAME},
+                {MARKER_NAME, CCA_LEX_LETTERS CCA_LEX_DIGITS, MARKER_NAME},
+
+                {START, ",", DIVIDER},
+
+                // only the opening character, the bodies are skipped by the vectorized scanners
+                {START, "'\"", STRING},
+                {START, ";", COMMENT},
+
+                {START, "0", NUMBER_ZERO},
+                {START, "123456789", NUMBER_DEC},
+                {NUMBER_ZERO, CCA_LEX_DIGITS, NUMBER_DEC},
+                {NUMBER_DEC, CCA_LEX_DIGITS, NUMBER_DEC},
+                {NUMBER_ZERO, "x", NUMBER_HEX_PREFIX},
+                {NUMBER_HEX_PREFIX, CCA_LEX_DIGITS "abcdefABCDEF", NUMBER_HEX},
+                {NUMBER_HEX, CCA_LEX_DIGITS "abcdefABCDEF", NUMBER_HEX},
+                {NUMBER_ZERO, "b", NUMBER_BIN_PREFIX},
+                {NUMBER_BIN_PREFIX, "01", NUMBER_BIN},
+                {NUMBER_BIN, "01", NUMBER_BIN},
+                {NUMBER_ZERO, "o", NUMBER_OCT_PREFIX},
+                {NUMBER_OCT_PREFIX, "01234567", NUMBER_OCT},
+                {NUMBER_OCT, "01234567", NUMBER_OCT},
+
+                {START, "&", ADDRESS},
+                {ADDRESS, "0", ADDRESS_ZERO},
+                {ADDRESS, "123456789", ADDRESS_DEC},
+                {ADDRESS_ZERO, CCA_LEX_DIGITS, ADDRESS_DEC},
+                {ADDRESS_DEC, CCA_LEX_DIGITS, ADDRESS_DEC},
+                {ADDRESS_ZERO, "x", ADDRESS_HEX_PREFIX},
+                {ADDRESS_HEX_PREFIX, CCA_LEX_DIGITS "abcdefABCDEF", ADDRESS_HEX},
+                {ADDRESS_HEX, CCA_LEX_DIGITS "abcdefABCDEF", ADDRESS_HEX},
+                {ADDRESS_ZERO, "b", ADDRESS_BIN_PREFIX},
+                {ADDRESS_BIN_PREFIX, "01", ADDRESS_BIN},
+                {ADDRESS_BIN, "01", ADDRESS_BIN},
+                {ADDRESS_ZERO, "o", ADDRESS_OCT_PREFIX},
+                {ADDRESS_OCT_PREFIX, "01234567", ADDRESS_OCT},
+                {ADDRESS_OCT, "01234567", ADDRESS_OCT},
+
+                {START, "%", DIRECTIVE},
+                {DIRECTIVE, CCA_LEX_LETTERS, DIRECTIVE_NAME},
+                {DIRECTIVE_NAME, CCA_LEX_LETTERS CCA_LEX_DIGITS, DIRECTIVE_NAME},
+        };
+
+#undef CCA_LEX_LETTERS
+#undef CCA_LEX_DIGITS
+
+        constexpr unsigned int RULE_COUNT = sizeof(rules) / sizeof(rules[0]);
+        constexpr unsigned int CLASS_LIMIT = 32;
+
+        static_assert(RULE_COUNT <= 64, "character class signatures are stored in 64 bits");
+
+        struct Tables {
+            unsigned char classes[256] = {};
+            unsigned char transitions[STATE_COUNT][CLASS_LIMIT] = {};
+            unsigned int classCount = 0;
+        };
+
+        constexpr bool contains(const char *characters, unsigned char c) {
+            for (; *characters; ++characters) {
+                if (static_cast<unsigned char>(*characters) == c)
+                    return true;
+            }
+
+            return false;
+        }
+
+        // characters that appear in exactly the same rules are interchangeable, so they share a class
+        constexpr Tables buildTables() {
+            Tables tables;
+            unsigned long long signatures[256] = {};
+
+            for (unsigned int c = 0; c < 256; c++) {
+                for (unsigned int r = 0; r < RULE_COUNT; r++) {
+                    if (contains(rules[r].characters, c))
+                        signatures[c] |= 1ull << r;
+                }
+            }
+
+            for (unsigned int c = 0; c < 256; c++) {
+                unsigned int d = 0;
+
+                while (d < c && signatures[d] != signatures[c])
+                    ++d;
+
+                tables.classes[c] = d < c ? tables.classes[d] : tables.classCount++;
+            }
+
+            for (unsigned int r = 0; r < RULE_COUNT; r++) {
+                for (unsigned int c = 0; c < 256; c++) {
+                    if (contains(rules[r].characters, c))
+                        tables.transitions[rules[r].from][tables.classes[c]] = rules[r].to;
+                }
+            }
+
+            return tables;
+        }
+
+        constexpr Tables tables = buildTables();
+
+        static_assert(tables.classCount <= CLASS_LIMIT, "too many character classes for the transition table");
+
+        // the state a token starting with c moves to, which says what kind of token it is
+        constexpr State startState(char c) {
+            return static_cast<State>(tables.transitions[START][tables.classes[static_cast<unsigned char>(c)]]);
+        }
+
+        // runs the automaton from position, returns the state it stopped in and leaves position after the match
+        State match(const char *code, size_t size, size_t &position) {
+            unsigned char state = START;
+
+            while (position < size) {
+                unsigned char next = tables.transitions[state][tables.classes[static_cast<unsigned char>(code[position])]];
+
+                if (next == STOP)
+                    break;
+
+                state = next;
+                ++position;
+            }
+
+            return static_cast<State>(state);
+        }
+    }
+}
@@ -0,0 +1,405 @@
+#pragma once
+
+// links object files written by cca -c into a single executable. the code and data sections of the objects are
+// placed one after the other, every exported symbol gets its address in the combined sections and the fields listed
+// in the relocation sections are patched with them. fields that refer to the same object only move with its sections
+//
+// loading the objects and looking up the symbols is done once, the copying and patching of the sections runs on
+// several threads, every object only writes to its own slice of the output so the threads never share a byte
+
+#include <cca/assembler.h>
+
+namespace CCA {
+    namespace Link {
+        struct ObjectSymbol {
+            SymbolKind kind;
+            uint32_t address;
+            std::string_view name;
+        };
+
+        // a field that holds the address of name, see StreamAssembler::relocationSection for the layout
+        struct Relocation {
+            uint32_t offset;
+            uint32_t opcodeOffset; // NO_OPCODE when the opcode doesn't depend on the symbol
+            unsigned char mnemonic;
+            unsigned char operandCount;
+            unsigned char operand;
+            TokenType types[MAX_OPERANDS];
+            std::string_view name;
+        };
+
+        // a field that holds an address within a section of its own object, it only moves with the section
+        struct LocalRelocation {
+            uint32_t offset;
+            SymbolKind section;
+        };
+
+        constexpr uint32_t NO_OPCODE = ~0u;
+
+        struct Object {
+            std::string fileName;
+            LoadedImage image;
+            std::string_view data;
+            std::string_view code;
+            std::vector<ObjectSymbol> symbols;
+            std::vector<Relocation> relocations;
+            std::vector<LocalRelocation> localRelocations;
+
+            // where the sections start in the linked executable
+            size_t dataBase = 0;
+            size_t codeBase = 0;
+
+            // found while patching, reported once every thread is done
+            std::vector<std::string> errors;
+
+            Object(const std::string &_fileName, unsigned int jobs) : fileName(_fileName), image(_fileName, jobs) {}
+        };
+
+        // reads the numbers and names of a section, stops at the end instead of reading past it
+        class SectionReader {
+        private:
+            std::string_view contents;
+            size_t position = 0;
+            bool failed = false;
+
+        public:
+            explicit SectionReader(std::string_view _contents) : contents(_contents) {}
+
+            uint64_t number(unsigned int width) {
+                if (failed || contents.size() - position < width) {
+                    failed = true;
+                    return 0;
+                }
+
+                uint64_t value = readBigEndian(contents.data() + position, width);
+                position += width;
+
+                return value;
+            }
+
+            std::string_view text(size_t size) {
+                if (failed || contents.size() - position < size) {
+                    failed = true;
+                    return {};
+                }
+
+                std::string_view value = contents.substr(position, size);
+                position += size;
+
+                return value;
+            }
+
+            bool ok() const {
+                return !failed;
+            }
+
+            // true when everything was read and nothing is left over
+            bool complete() const {
+                return !failed && position == contents.size();
+            }
+        };
+
+        [[noreturn]] void invalidObject(const std::string &fileName, const char *reason) {
+            std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " '" << fileName
+                      << "' is not a valid object file, " << reason << "\n\n";
+            std::exit(-1);
+        }
+
+        void readSections(Object &object) {
+            const LoadedSection *data = object.image.find(SectionKind::DATA);
+            const LoadedSection *code = object.image.find(SectionKind::CODE);
+            const LoadedSection *symbols = object.image.find(SectionKind::SYMBOLS);
+            const LoadedSection *relocations = object.image.find(SectionKind::RELOCATIONS);
+
+            if (!data || !code || !symbols || !relocations)
+                invalidObject(object.fileName, "it needs data, code, symbol and relocation sections");
+
+            object.data = data->contents;
+            object.code = code->contents;
+
+            SectionReader symbolReader(symbols->contents);
+            uint64_t symbolCount = symbolReader.number(4);
+
+            for (uint64_t i = 0; i < symbolCount && symbolReader.ok(); i++) {
+                ObjectSymbol symbol;
+                symbol.kind = static_cast<SymbolKind>(symbolReader.number(1));
+                symbol.address = symbolReader.number(4);
+                symbol.name = symbolReader.text(symbolReader.number(2));
+
+                if (!symbolReader.ok())
+                    break;
+
+                bool inside = symbol.kind == SymbolKind::MARKER ? symbol.address <= object.code.size()
+                                                                : symbol.address <= object.data.size();
+
+                if (symbol.kind != SymbolKind::MARKER && symbol.kind != SymbolKind::DEFINITION)
+                    invalidObject(object.fileName, "a symbol has an unknown kind");
+
+                if (!inside)
+                    invalidObject(object.fileName, "a symbol lies outside of its section");
+
+                object.symbols.push_back(symbol);
+            }
+
+            if (!symbolReader.complete())
+                invalidObject(object.fileName, "the symbol section is malformed");
+
+            SectionReader relocationReader(relocations->contents);
+            uint64_t relocationCount = relocationReader.number(4);
+
+            for (uint64_t i = 0; i < relocationCount && relocationReader.ok(); i++) {
+                Relocation relocation;
+                relocation.offset = relocationReader.number(4);
+                SymbolKind local = static_cast<SymbolKind>(relocationReader.number(1));
+
+                if (!relocationReader.ok())
+                    break;
+
+                if (relocation.offset > object.code.size() || object.code.size() - relocation.offset < 4)
+                    invalidObject(object.fileName, "a relocation lies outside of the code");
+
+                // kept apart, so the records of each instruction that are looked up by name stay next to each other
+                if (local != SymbolKind::NONE) {
+                    if (local != SymbolKind::MARKER && local != SymbolKind::DEFINITION)
+                        invalidObject(object.fileName, "a relocation has an unknown kind");
+
+                    uint64_t address = readBigEndian(object.code.data() + relocation.offset, 4);
+                    size_t size = local == SymbolKind::MARKER ? object.code.size() : object.data.size();
+
+                    if (address > size)
+                        invalidObject(object.fileName, "a relocation points outside of its section");
+
+                    object.localRelocations.push_back(LocalRelocation{relocation.offset, local});
+                    continue;
+                }
+
+                relocation.opcodeOffset = relocationReader.number(4);
+                relocation.mnemonic = relocationReader.number(1);
+                relocation.operandCount = relocationReader.number(1);
+                relocation.operand = relocationReader.number(1);
+
+                for (auto &type: relocation.types)
+                    type = static_cast<TokenType>(relocationReader.number(1));
+
+                relocation.name = relocationReader.text(relocationReader.number(2));
+
+                if (!relocationReader.ok())
+                    break;
+
+                if (relocation.opcodeOffset != NO_OPCODE
+                    && (relocation.opcodeOffset >= object.code.size() || relocation.mnemonic >= MNEMONIC_COUNT
+                        || relocation.operandCount > MAX_OPERANDS || relocation.operand >= relocation.operandCount))
+                    invalidObject(object.fileName, "a relocation has an invalid instruction");
+
+                object.relocations.push_back(relocation);
+            }
+
+            if (!relocationReader.complete())
+                invalidObject(object.fileName, "the relocation section is malformed");
+        }
+
+        // the names of every object in one table, with their addresses in the linked executable
+        struct GlobalSymbols {
+            SymbolPool names;
+            SymbolTable table;
+
+            // where each symbol came from, for reporting duplicates
+            std::vector<const Object *> owners;
+        };
+
+        void collectSymbols(std::deque<Object> &objects, GlobalSymbols &globals) {
+            bool duplicates = false;
+
+            for (auto &object: objects) {
+                for (auto &s: object.symbols) {
+                    uint32_t name = globals.names.intern(s.name);
+                    size_t base = s.kind == SymbolKind::MARKER ? object.codeBase : object.dataBase;
+                    int address = static_cast<int>(base + s.address);
+                    const Symbol *existing = globals.table.insert(Symbol{name, s.kind, address, 0});
+
+                    if (globals.owners.size() <= name)
+                        globals.owners.resize(name + 1, nullptr);
+
+                    if (!existing) {
+                        globals.owners[name] = &object;
+                        continue;
+                    }
+
+                    std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " Symbol '" << s.name
+                              << "' is defined in " << termcolor::red << globals.owners[name]->fileName
+                              << termcolor::reset << " and " << termcolor::red << object.fileName
+                              << termcolor::reset << "\n\n";
+                    duplicates = true;
+                }
+            }
+
+            if (duplicates) {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                          << " Aborting due to errors while linking\n\n";
+                std::exit(-1);
+            }
+        }
+
+        // copies the sections of the object into its slices of the output and patches its relocations. records of
+        // the same instruction are next to each other, its opcode is picked once all of them are known
+        void linkObject(Object &object, const GlobalSymbols &globals, std::vector<char> &data,
+                        std::vector<unsigned char> &code) {
+            std::memcpy(data.data() + object.dataBase, object.data.data(), object.data.size());
+            std::memcpy(code.data() + object.codeBase, object.code.data(), object.code.size());
+
+            unsigned char *bytecode = code.data() + object.codeBase;
+            TokenType types[MAX_OPERANDS];
+
+            // these fields already hold the address within the sections of the object
+            for (auto &r: object.localRelocations) {
+                size_t base = r.section == SymbolKind::MARKER ? object.codeBase : object.dataBase;
+                uint32_t address = readBigEndian(object.code.data() + r.offset, 4) + base;
+
+                for (int b = 0; b < 4; b++)
+                    bytecode[r.offset + b] = (address >> (24 - 8 * b)) & 0xFF;
+            }
+
+            for (size_t i = 0; i < object.relocations.size(); i++) {
+                const Relocation &r = object.relocations[i];
+                uint32_t name;
+                const Symbol *symbol = globals.names.find(r.name, name) ? globals.table.find(name) : nullptr;
+
+                if (!symbol) {
+                    object.errors.push_back("Could not match identifier '" + std::string(r.name) + "' in "
+                                            + object.fileName);
+                    continue;
+                }
+
+                for (int b = 0; b < 4; b++)
+                    bytecode[r.offset + b] = (symbol->address >> (24 - 8 * b)) & 0xFF;
+
+                if (r.opcodeOffset == NO_OPCODE)
+                    continue;
+
+                bool first = i == 0 || object.relocations[i - 1].opcodeOffset != r.opcodeOffset;
+                bool last = i + 1 == object.relocations.size()
+                            || object.relocations[i + 1].opcodeOffset != r.opcodeOffset;
+
+                if (first)
+                    std::copy(r.types, r.types + MAX_OPERANDS, types);
+
+                types[r.operand] = symbolType(symbol->kind);
+
+                if (!last)
+                    continue;
+
+                Encoding encoding = findEncoding(r.mnemonic, types, r.operandCount);
+
+                if (encoding.valid) {
+                    bytecode[r.opcodeOffset] = encoding.opcode;
+                    continue;
+                }
+
+                std::string error = std::string(mnemonics[r.mnemonic].name) + " does not take (";
+
+                for (unsigned int t = 0; t < r.operandCount; t++)
+                    error += std::string(t ? ", " : "") + stringifyToken(types[t]);
+
+                object.errors.push_back(error + ") in " + object.fileName);
+            }
+        }
+
+        // links the objects and writes the executable, exits when there were errors
+        void link(const std::vector<std::string> &fileNames, const std::string &outputName, unsigned int jobs,
+                  const ImageOptions &options) {
+            // objects hold their mapped files, so they are never moved
+            std::deque<Object> objects;
+
+            for (auto &fileName: fileNames) {
+                objects.emplace_back(fileName, jobs);
+                readSections(objects.back());
+            }
+
+            // the sections are laid out in the order the objects were given
+            size_t dataSize = 0;
+            size_t codeSize = 0;
+
+            for (auto &object: objects) {
+                object.dataBase = dataSize;
+                object.codeBase = codeSize;
+                dataSize += object.data.size();
+                codeSize += object.code.size();
+            }
+
+            if (dataSize > INT32_MAX || codeSize > INT32_MAX) {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                          << " The linked executable is too large to address\n\n";
+                std::exit(-1);
+            }
+
+            GlobalSymbols globals;
+            collectSymbols(objects, globals);
+
+            std::vector<char> data(dataSize);
+            std::vector<unsigned char> code(codeSize);
+
+            jobs = std::max<size_t>(1, std::min<size_t>(jobs, objects.size()));
+
+            auto linkRange = [&](size_t first, size_t last) {
+                for (size_t i = first; i < last; i++)
+                    linkObject(objects[i], globals, data, code);
+            };
+
+            if (jobs == 1) {
+                linkRange(0, objects.size());
+            } else {
+                std::vector<std::thread> workers;
+
+                for (unsigned int j = 0; j < jobs; j++)
+                    workers.emplace_back(linkRange, objects.size() * j / jobs, objects.size() * (j + 1) / jobs);
+
+                for (auto &worker: workers)
+                    worker.join();
+            }
+
+            bool errors = false;
+
+            for (auto &object: objects) {
+                for (auto &error: object.errors) {
+                    std::cout << termcolor::red << "[ERROR]" << termcolor::reset << " " << error << "\n\n";
+                    errors = true;
+                }
+            }
+
+            if (errors) {
+                std::cout << termcolor::red << "[ERROR]" << termcolor::reset
+                          << " Aborting due to errors while linking\n\n";
+                std::exit(-1);
+            }
+
+            std::vector<Section> sections = {
+                    {SectionKind::DATA, 0, {data.data(), data.size()}},
+                    {SectionKind::CODE, 0, {code.data(), code.size()}}
+            };
+
+            std::vector<char> symbolData;
+
+            if (options.symbols) {
+                std::vector<Definition> definitions;
+                std::vector<Marker> markers;
+
+                for (auto &object: objects) {
+                    for (auto &s: object.symbols) {
+                        uint32_t name = globals.names.intern(s.name);
+
+                        if (s.kind == SymbolKind::MARKER)
+                            markers.push_back(Marker{name, 0, static_cast<int>(object.codeBase + s.address), 0});
+                        else
+                            definitions.push_back(Definition{static_cast<int>(object.dataBase + s.address), {}, name,
+                                                             0});
+                    }
+                }
+
+                symbolData = symbolSection(definitions, markers, globals.names);
+                sections.push_back({SectionKind::SYMBOLS, 0, {symbolData.data(), symbolData.size()}});
+            }
+
+            writeContainer(outputName, sections, options.compress);
+        }
+    }
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+// small LZ77 codec in the style of LZ4 for the sections of an executable. input is cut into blocks that are
+// compressed on their own, so a loader can decompress them in parallel or one at a time as they arrive
+//
+// a block is a list of sequences, every sequence is
+//   token     high 4 bits amount of literals, low 4 bits match length - MIN_MATCH, 15 means more length bytes follow
+//   literals  with extra length bytes first, each one adds up to 255 until one is smaller
+//   offset    2 bytes big endian, how far back the match starts
+//   length    extra match length bytes, the same way as for the literals
+// the last sequence of a block only has literals
+//
+// a compressed stream is the uncompressed size (8 bytes), the block size (4 bytes), the amount of blocks (4 bytes),
+// the compressed size of every block (4 bytes each, the top bit marks a block that is stored as it is because it
+// didn't get smaller) and then the blocks. every number is big endian. blocks are at most BLOCK_SIZE bytes, readers
+// reject streams with larger ones
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace CCA {
+    namespace Lz {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr size_t BLOCK_SIZE = 1 << 18;
+        constexpr unsigned int HASH_BITS = 16;
+        constexpr uint32_t STORED = 0x80000000u;
+
+        constexpr size_t STREAM_HEADER_SIZE = 16;
+
+        // a compressed byte never stands for more than this many decompressed ones, a match is at least 3 bytes for
+        // up to 18 and every length byte after that adds at most 255
+        constexpr uint64_t MAX_EXPANSION = 255;
+
+        uint32_t read32(const unsigned char *p) {
+            return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | p[3];
+        }
+
+        void pushNumber(std::vector<unsigned char> &output, uint64_t value, unsigned int width = 4) {
+            for (unsigned int i = 0; i < width; i++)
+                output.push_back((value >> (8 * (width - 1 - i))) & 0xFF);
+        }
+
+        uint32_t hash(const unsigned char *p) {
+            uint32_t bytes;
+            std::memcpy(&bytes, p, 4);
+
+            return (bytes * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        void pushLength(std::vector<unsigned char> &output, size_t length) {
+            for (; length >= 255; length -= 255)
+                output.push_back(255);
+
+            output.push_back(length);
+        }
+
+        void pushSequence(std::vector<unsigned char> &output, const unsigned char *literals, size_t literalCount,
+                          size_t offset, size_t matchLength) {
+            size_t extraMatch = matchLength ? matchLength - MIN_MATCH : 0;
+
+            output.push_back((literalCount < 15 ? literalCount : 15) << 4 | (extraMatch < 15 ? extraMatch : 15));
+
+            if (literalCount >= 15)
+                pushLength(output, literalCount - 15);
+
+            output.insert(output.end(), literals, literals + literalCount);
+
+            if (!matchLength)
+                return;
+
+            output.push_back(offset >> 8);
+            output.push_back(offset & 0xFF);
+
+            if (extraMatch >= 15)
+                pushLength(output, extraMatch - 15);
+        }
+
+        // appends the compressed form of the block to output, greedy matching against the last position every
+        // hash of 4 bytes was seen at
+        void compressBlock(const unsigned char *input, size_t size, std::vector<unsigned char> &output) {
+            std::vector<uint32_t> table(1 << HASH_BITS, UINT32_MAX);
+            size_t anchor = 0;
+            size_t position = 0;
+
+            while (size >= MIN_MATCH && position <= size - MIN_MATCH) {
+                uint32_t &slot = table[hash(input + position)];
+                size_t candidate = slot;
+                slot = position;
+
+                if (candidate == UINT32_MAX || position - candidate > MAX_OFFSET
+                    || std::memcmp(input + candidate, input + position, MIN_MATCH) != 0) {
+                    ++position;
+                    continue;
+                }
+
+                size_t length = MIN_MATCH;
+
+                while (position + length < size && input[candidate + length] == input[position + length])
+                    ++length;
+
+                pushSequence(output, input + anchor, position - anchor, position - candidate, length);
+
+                position += length;
+                anchor = position;
+            }
+
+            pushSequence(output, input + anchor, size - anchor, 0, 0);
+        }
+
+        bool readLength(const unsigned char *&p, const unsigned char *end, size_t &length) {
+            unsigned char byte;
+
+            do {
+                if (p == end)
+                    return false;
+
+                byte = *p++;
+                length += byte;
+            } while (byte == 255);
+
+            return true;
+        }
+
+        // decompresses a block into exactly outputSize bytes, returns false when it is malformed
+        bool decompressBlock(const unsigned char *input, size_t size, unsigned char *output, size_t outputSize) {
+            const unsigned char *p = input;
+            const unsigned char *end = input + size;
+            size_t written = 0;
+
+            while (p < end) {
+                unsigned char token = *p++;
+                size_t literals = token >> 4;
+
+                if (literals == 15 && !readLength(p, end, literals))
+                    return false;
+
+                if (literals > size_t(end - p) || literals > outputSize - written)
+                    return false;
+
+                std::memcpy(output + written, p, literals);
+                p += literals;
+                written += literals;
+
+                // the last sequence ends after its literals
+                if (p == end)
+                    break;
+
+                if (end - p < 2)
+                    return false;
+
+                size_t offset = size_t(p[0]) << 8 | p[1];
+                size_t length = token & 0xF;
+                p += 2;
+
+                if (length == 15 && !readLength(p, end, length))
+                    return false;
+
+                length += MIN_MATCH;
+
+                if (offset == 0 || offset > written || length > outputSize - written)
+                    return false;
+
+                // matches can overlap the bytes they produce, which repeats them
+                const unsigned char *from = output + written - offset;
+
+                if (offset >= length) {
+                    std::memcpy(output + written, from, length);
+                } else {
+                    for (size_t i = 0; i < length; i++)
+                        output[written + i] = from[i];
+                }
+
+                written += length;
+            }
+
+            return written == outputSize;
+        }
+
+        // blockSize can't be larger than BLOCK_SIZE
+        std::vector<unsigned char> compress(const unsigned char *data, size_t size, size_t blockSize = BLOCK_SIZE) {
+            size_t blocks = (size + blockSize - 1) / blockSize;
+            std::vector<unsigned char> output;
+            std::vector<unsigned char> block;
+
+            pushNumber(output, size, 8);
+            pushNumber(output, blockSize);
+            pushNumber(output, blocks);
+
+            size_t sizes = output.size();
+            output.resize(output.size() + 4 * blocks);
+
+            for (size_t i = 0; i < blocks; i++) {
+                const unsigned char *input = data + i * blockSize;
+                size_t length = std::min(blockSize, size - i * blockSize);
+                uint32_t entry;
+
+                block.clear();
+                compressBlock(input, length, block);
+
+                if (block.size() < length) {
+                    output.insert(output.end(), block.begin(), block.end());
+                    entry = block.size();
+                } else {
+                    output.insert(output.end(), input, input + length);
+                    entry = length | STORED;
+                }
+
+                for (int b = 0; b < 4; b++)
+                    output[sizes + 4 * i + b] = (entry >> (24 - 8 * b)) & 0xFF;
+            }
+
+            return output;
+        }
+
+        // decompresses a stream, the blocks are spread over the given amount of threads. returns false when the
+        // stream is malformed
+        bool decompress(const unsigned char *data, size_t size, std::vector<unsigned char> &output,
+                        unsigned int jobs = 1) {
+            if (size < STREAM_HEADER_SIZE)
+                return false;
+
+            uint64_t total = uint64_t(read32(data)) << 32 | read32(data + 4);
+            size_t blockSize = read32(data + 8);
+            size_t blocks = read32(data + 12);
+
+            // the header is checked against the size of the stream before anything is allocated for it
+            if (blockSize == 0 || blockSize > BLOCK_SIZE || blocks > (size - STREAM_HEADER_SIZE) / 4)
+                return false;
+
+            if (blocks != total / blockSize + (total % blockSize != 0)
+                || total > (size - STREAM_HEADER_SIZE - 4 * blocks) * MAX_EXPANSION)
+                return false;
+
+            // where every block starts, known from the sizes alone so the blocks can be decoded in any order
+            std::vector<size_t> starts(blocks + 1, STREAM_HEADER_SIZE + 4 * blocks);
+
+            for (size_t i = 0; i < blocks; i++)
+                starts[i + 1] = starts[i] + (read32(data + STREAM_HEADER_SIZE + 4 * i) & ~STORED);
+
+            if (starts[blocks] != size)
+                return false;
+
+            output.resize(total);
+
+            auto decodeRange = [&](size_t first, size_t last) {
+                bool valid = true;
+
+                for (size_t i = first; i < last && valid; i++) {
+                    const unsigned char *block = data + starts[i];
+                    size_t length = starts[i + 1] - starts[i];
+                    size_t outputSize = std::min<uint64_t>(blockSize, total - i * blockSize);
+
+                    if (read32(data + STREAM_HEADER_SIZE + 4 * i) & STORED) {
+                        valid = length == outputSize;
+
+                        if (valid)
+                            std::memcpy(output.data() + i * blockSize, block, length);
+                    } else {
+                        valid = decompressBlock(block, length, output.data() + i * blockSize, outputSize);
+                    }
+                }
+
+                return valid;
+            };
+
+            jobs = std::max<size_t>(1, std::min<size_t>(jobs, blocks));
+
+            if (jobs == 1)
+                return decodeRange(0, blocks);
+
+            std::vector<std::thread> workers;
+            std::vector<char> results(jobs);
+
+            for (unsigned int j = 0; j < jobs; j++) {
+                workers.emplace_back([&, j]() {
+                    results[j] = decodeRange(blocks * j / jobs, blocks * (j + 1) / jobs);
+                });
+            }
+
+            for (auto &worker: workers)
+                worker.join();
+
+            for (char result: results) {
+                if (!result)
+                    return false;
+            }
+
+            return true;
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+// bounded queue between exactly one producer thread and one consumer thread. the producer only writes tail and the
+// consumer only writes head, so each index lives on its own cache line and a slot is handed over by the release
+// store of the index that covers it. a side that has to wait spins for a moment and then sleeps until the other
+// side moves its index, so a stage that is far ahead of the other one doesn't keep a core busy
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace CCA {
+    template <typename T>
+    class SpscRing {
+    private:
+        static constexpr size_t CACHE_LINE = 64;
+        static constexpr int SPINS = 64;
+
+        std::vector<T> slots;
+        size_t mask;
+
+        alignas(CACHE_LINE) std::atomic<size_t> head{0}; // next slot to pop
+        alignas(CACHE_LINE) std::atomic<size_t> tail{0}; // next slot to push
+
+        // a side registers as sleeping and looks at the ring once more while it holds the mutex, the other side
+        // only takes the mutex to wake it, so an index that moves in between is never missed
+        alignas(CACHE_LINE) std::atomic<unsigned int> sleeping{0};
+        std::mutex mutex;
+        std::condition_variable moved;
+
+        // called after moving an index. both sides change sleeping with a read-modify-write, if this one comes
+        // first the sleeper reads from it and sees the index, otherwise this one sees the sleeper
+        void wake() {
+            if (sleeping.fetch_add(0, std::memory_order_acq_rel) == 0)
+                return;
+
+            std::lock_guard<std::mutex> lock(mutex);
+            moved.notify_all();
+        }
+
+        // returns once attempt succeeded
+        template <typename Attempt>
+        void wait(Attempt attempt) {
+            for (int spin = 0; spin < SPINS; spin++) {
+                if (attempt())
+                    return;
+
+                std::this_thread::yield();
+            }
+
+            std::unique_lock<std::mutex> lock(mutex);
+            sleeping.fetch_add(1, std::memory_order_acq_rel);
+
+            moved.wait(lock, attempt);
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+    public:
+        // the capacity is rounded up to a power of two
+        explicit SpscRing(size_t capacity) {
+            size_t size = 1;
+
+            while (size < capacity)
+                size <<= 1;
+
+            slots.resize(size);
+            mask = size - 1;
+        }
+
+        // producer side, false when the ring is full
+        bool tryPush(const T &value) {
+            size_t position = tail.load(std::memory_order_relaxed);
+
+            if (position - head.load(std::memory_order_acquire) == slots.size())
+                return false;
+
+            slots[position & mask] = value;
+            tail.store(position + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // consumer side, false when the ring is empty
+        bool tryPop(T &value) {
+            size_t position = head.load(std::memory_order_relaxed);
+
+            if (position == tail.load(std::memory_order_acquire))
+                return false;
+
+            value = slots[position & mask];
+            head.store(position + 1, std::memory_order_release);
+
+            return true;
+        }
+
+        // wait for room or for a value, whoever waits on the other side is woken up afterwards
+        void push(const T &value) {
+            wait([&]() { return tryPush(value); });
+            wake();
+        }
+
+        void pop(T &value) {
+            wait([&]() { return tryPop(value); });
+            wake();
+        }
+    };
+}
@@ -0,0 +1,250 @@
+#pragma once
+
+// vectorized scanning primitives used by the lexer to skip over whitespace, comments and string bodies
+// SSE2 is the baseline on x86-64, AVX2 is picked at runtime when the cpu supports it, other targets use
+// the scalar loops
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CCA_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define CCA_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define CCA_TARGET_AVX2
+#endif
+
+namespace CCA {
+    namespace Scan {
+        enum class Level {
+            SCALAR,
+            SSE2,
+            AVX2
+        };
+
+        struct Scanner {
+            // returns the first character that is not whitespace, adds the skipped newlines to newlines
+            const char *(*skipWhitespace)(const char *p, const char *end, int &newlines);
+
+            // returns the first occurrence of c, or end if there is none
+            const char *(*findByte)(const char *p, const char *end, char c);
+
+            // returns the first occurrence of either a or b, or end if there is none
+            const char *(*findEither)(const char *p, const char *end, char a, char b);
+        };
+
+        int popcount(unsigned int mask) {
+#if defined(__GNUC__)
+            return __builtin_popcount(mask);
+#else
+            int count = 0;
+
+            for (; mask; mask &= mask - 1)
+                ++count;
+
+            return count;
+#endif
+        }
+
+        int countTrailingZeros(unsigned int mask) {
+#if defined(__GNUC__)
+            return __builtin_ctz(mask);
+#else
+            int count = 0;
+
+            while (!(mask & 1)) {
+                mask >>= 1;
+                ++count;
+            }
+
+            return count;
+#endif
+        }
+
+        const char *skipWhitespaceScalar(const char *p, const char *end, int &newlines) {
+            for (; p < end; ++p) {
+                if (*p == '\n')
+                    ++newlines;
+                else if (*p != ' ' && *p != '\t' && *p != '\r')
+                    break;
+            }
+
+            return p;
+        }
+
+        const char *findByteScalar(const char *p, const char *end, char c) {
+            while (p < end && *p != c)
+                ++p;
+
+            return p;
+        }
+
+        const char *findEitherScalar(const char *p, const char *end, char a, char b) {
+            while (p < end && *p != a && *p != b)
+                ++p;
+
+            return p;
+        }
+
+#ifdef CCA_SCAN_X86
+        const char *skipWhitespaceSSE2(const char *p, const char *end, int &newlines) {
+            const __m128i space = _mm_set1_epi8(' ');
+            const __m128i tab = _mm_set1_epi8('\t');
+            const __m128i newline = _mm_set1_epi8('\n');
+            const __m128i carriage = _mm_set1_epi8('\r');
+
+            while (end - p >= 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                __m128i lines = _mm_cmpeq_epi8(chunk, newline);
+                __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                                             _mm_or_si128(_mm_cmpeq_epi8(chunk, carriage), lines));
+
+                unsigned int stop = ~_mm_movemask_epi8(blank) & 0xFFFF;
+                unsigned int lineMask = _mm_movemask_epi8(lines);
+
+                if (stop) {
+                    int offset = countTrailingZeros(stop);
+                    newlines += popcount(lineMask & ((1u << offset) - 1));
+                    return p + offset;
+                }
+
+                newlines += popcount(lineMask);
+                p += 16;
+            }
+
+            return skipWhitespaceScalar(p, end, newlines);
+        }
+
+        const char *findByteSSE2(const char *p, const char *end, char c) {
+            const __m128i needle = _mm_set1_epi8(c);
+
+            while (end - p >= 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+
+                if (mask)
+                    return p + countTrailingZeros(mask);
+
+                p += 16;
+            }
+
+            return findByteScalar(p, end, c);
+        }
+
+        const char *findEitherSSE2(const char *p, const char *end, char a, char b) {
+            const __m128i first = _mm_set1_epi8(a);
+            const __m128i second = _mm_set1_epi8(b);
+
+            while (end - p >= 16) {
+                __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+                unsigned int mask = _mm_movemask_epi8(
+                        _mm_or_si128(_mm_cmpeq_epi8(chunk, first), _mm_cmpeq_epi8(chunk, second)));
+
+                if (mask)
+                    return p + countTrailingZeros(mask);
+
+                p += 16;
+            }
+
+            return findEitherScalar(p, end, a, b);
+        }
+
+        CCA_TARGET_AVX2 const char *skipWhitespaceAVX2(const char *p, const char *end, int &newlines) {
+            const __m256i space = _mm256_set1_epi8(' ');
+            const __m256i tab = _mm256_set1_epi8('\t');
+            const __m256i newline = _mm256_set1_epi8('\n');
+            const __m256i carriage = _mm256_set1_epi8('\r');
+
+            while (end - p >= 32) {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                __m256i lines = _mm256_cmpeq_epi8(chunk, newline);
+                __m256i blank = _mm256_or_si256(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, space), _mm256_cmpeq_epi8(chunk, tab)),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, carriage), lines));
+
+                unsigned int stop = ~static_cast<unsigned int>(_mm256_movemask_epi8(blank));
+                unsigned int lineMask = _mm256_movemask_epi8(lines);
+
+                if (stop) {
+                    int offset = countTrailingZeros(stop);
+                    newlines += popcount(offset == 0 ? 0 : lineMask & (0xFFFFFFFFu >> (32 - offset)));
+                    return p + offset;
+                }
+
+                newlines += popcount(lineMask);
+                p += 32;
+            }
+
+            return skipWhitespaceSSE2(p, end, newlines);
+        }
+
+        CCA_TARGET_AVX2 const char *findByteAVX2(const char *p, const char *end, char c) {
+            const __m256i needle = _mm256_set1_epi8(c);
+
+            while (end - p >= 32) {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+
+                if (mask)
+                    return p + countTrailingZeros(mask);
+
+                p += 32;
+            }
+
+            return findByteSSE2(p, end, c);
+        }
+
+        CCA_TARGET_AVX2 const char *findEitherAVX2(const char *p, const char *end, char a, char b) {
+            const __m256i first = _mm256_set1_epi8(a);
+            const __m256i second = _mm256_set1_epi8(b);
+
+            while (end - p >= 32) {
+                __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                unsigned int mask = _mm256_movemask_epi8(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(chunk, first), _mm256_cmpeq_epi8(chunk, second)));
+
+                if (mask)
+                    return p + countTrailingZeros(mask);
+
+                p += 32;
+            }
+
+            return findEitherSSE2(p, end, a, b);
+        }
+#endif
+
+        Level detectLevel() {
+#ifdef CCA_SCAN_X86
+#if defined(__GNUC__)
+            if (__builtin_cpu_supports("avx2"))
+                return Level::AVX2;
+#endif
+            return Level::SSE2;
+#else
+            return Level::SCALAR;
+#endif
+        }
+
+        // returns the scanner for the given level, levels the platform can't run fall back to the best one it can
+        Scanner scannerFor(Level level) {
+#ifdef CCA_SCAN_X86
+            if (level == Level::AVX2 && detectLevel() == Level::AVX2)
+                return Scanner{skipWhitespaceAVX2, findByteAVX2, findEitherAVX2};
+
+            if (level != Level::SCALAR)
+                return Scanner{skipWhitespaceSSE2, findByteSSE2, findEitherSSE2};
+#endif
+            return Scanner{skipWhitespaceScalar, findByteScalar, findEitherScalar};
+        }
+
+        Scanner active = scannerFor(detectLevel());
+
+        // overrides the runtime detection, mostly useful for benchmarking the different paths
+        void useLevel(Level level) {
+            active = scannerFor(level);
+        }
+    }
+}
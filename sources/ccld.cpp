@@ -0,0 +1,52 @@
+#include <iostream>
+
+#include <cca/linker.h>
+
+#include <cxxopt/cxxopt.hpp>
+#include <termcolor/termcolor.hpp>
+
+int main(int argc, char* argv[]) {
+	cxxopts::Options options("ccld", "Links object files written by cca -c into an executable\n");
+
+	options.add_options()
+		("s,silent", "Dont display any info except errors")
+		("h,help", "Display this information")
+		("j,jobs", "Patch the objects on <arg> threads", cxxopts::value<unsigned int>()->default_value("1"))
+		("symbols", "Add a section with the addresses of markers and definitions to the executable")
+		("z,compress", "Compress the sections of the executable")
+		("o,output", "Outputs the executable to the file named <arg>", cxxopts::value<std::string>());
+
+	cxxopts::ParseResult result;
+	
+	try {
+		result = options.parse(argc, argv);
+	} catch (const cxxopts::OptionParseException& e) {
+		std::cout << termcolor::red << "[ERROR] " << termcolor::reset << e.what() << "\n\n";
+		std::exit(-1);
+	}
+
+	cxxopts::PositionalList args = result.unmatched();
+
+	if (result.count("help") || args.size() == 0) {
+		std::cout << options.help() << "\n";
+		std::exit(0);
+	}
+
+	std::vector<std::string> fileNames(args.begin(), args.end());
+	std::string outputName = result.count("output") ? result["output"].as<std::string>() : "a.ccb";
+	auto begin = std::chrono::high_resolution_clock::now();
+
+	CCA::Link::link(fileNames, outputName, result["jobs"].as<unsigned int>(),
+	                CCA::ImageOptions{false, result.count("symbols") > 0, result.count("compress") > 0});
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	if (!result.count("silent")) {
+		std::cout << termcolor::green << "[INFO]" << termcolor::reset << " Linked " << termcolor::green
+		          << outputName << termcolor::reset << " from " << fileNames.size() << " objects, took "
+		          << termcolor::green << std::chrono::duration<double, std::milli>(end - begin).count()
+		          << termcolor::reset << "ms\n\n";
+	}
+
+	std::exit(0);
+}
@@ -14,6 +14,14 @@ int main(int argc, char* argv[]) {
 		("h,help", "Display this information")
 		("v,version", "Display the assembler version")
 		("w,watch", "Watch for file changes")
+		("j,jobs", "Lex and encode the input on <arg> threads", cxxopts::value<unsigned int>()->default_value("1"))
+		("p,single-pass", "Assemble while lexing instead of in separate passes")
+		("pipeline", "Like --single-pass, but lex on a thread of its own while the tokens are assembled")
+		("wide", "Always use the 32 bit forms of branches and immediates, like older versions of the vm expect")
+		("legacy", "Write the old layout without a section table, data first and code after the magic number")
+		("symbols", "Add a section with the addresses of markers and definitions to the executable")
+		("z,compress", "Compress the sections of the executable")
+		("c,compile", "Write an object file for ccld, references that are not in the file are left to the linker")
 		("o,output", "Outputs the bytecode to the file named <arg>", cxxopts::value<std::string>());
 
 	cxxopts::ParseResult result;
@@ -40,6 +48,11 @@ int main(int argc, char* argv[]) {
 	if (args.size() > 0) {
 		std::string fileName = args[0];
 
+		if (result.count("watch") && fileName == "-") {
+			std::cout << termcolor::red << "[ERROR] " << termcolor::reset << "Can't watch stdin for changes\n\n";
+			std::exit(-1);
+		}
+
 		if (result.count("watch"))
 			CCA::watchAssembly(fileName, result);
 		else
@@ -0,0 +1,51 @@
+#pragma once
+
+// generated programs the tests and the benchmarks assemble, large sources that are valid and reproducible
+
+#include <cca/assembler.h>
+
+// a program of blocks that each define a message, mark a label and run a few instructions using both. the jump of
+// a block goes to a label far away in either direction, so nothing benefits from locality in the names. with
+// comments every block also gets the comment lines and padding generated code tends to have
+std::string generateSource(size_t blocks, bool comments = false) {
+    const char *messages[] = {"Processing record ", "Done with stage ", "Warning: retrying request ",
+                              "Connection to node "};
+    std::string code;
+
+    for (size_t i = 0; i < blocks; i++) {
+        code += "def message" + std::to_string(i) + " \"" + messages[i % 4] + std::to_string(i % 1000) + "\\n\"\n";
+        code += ":label" + std::to_string(i) + "\n";
+
+        if (comments) {
+            code += "    ; ------------------------------------------------------------------------------\n";
+            code += "    ; move the message into place before calling the print routine, the generator\n";
+            code += "    ; emits these comments for every block so that the output stays readable\n";
+            code += "    ; ------------------------------------------------------------------------------\n";
+            code += "                                                                                \n";
+        }
+
+        code += "    MOV a, 1\n";
+        code += "    MOV b, message" + std::to_string(i) + (comments ? " ; the message of this block\n" : "\n");
+        code += "    MOV c, " + std::to_string(i % 300) + "\n";
+        code += "    SYS\n";
+        code += "    PSH 0x1234\n";
+        code += "    POP d\n";
+        code += "    ADD d, 1\n";
+        code += "    JNE label" + std::to_string(i * 7919 % blocks) + "\n";
+    }
+
+    return code;
+}
+
+// generateSource with enough blocks for at least size bytes
+std::string generateSourceOfSize(size_t size, bool comments = false) {
+    size_t blocks = size / generateSource(1, comments).size() + 1;
+    std::string code = generateSource(blocks, comments);
+
+    while (code.size() < size) {
+        blocks += blocks / 8 + 1;
+        code = generateSource(blocks, comments);
+    }
+
+    return code;
+}
@@ -0,0 +1,88 @@
+// lexes sources on several threads and checks that the tokens, names, lines and errors are the ones lexing on a
+// single thread gives, also when strings and comments run across the places the source is split at
+
+#include "test.h"
+
+struct Lexed {
+    CCA::SymbolPool symbols;
+    CCA::TokenStore tokens;
+    CCA::LexState state;
+};
+
+bool same(const Lexed &a, const Lexed &b) {
+    if (a.tokens.types != b.tokens.types || a.tokens.lines != b.tokens.lines || a.tokens.values != b.tokens.values
+        || a.tokens.spans != b.tokens.spans || a.symbols.size() != b.symbols.size())
+        return false;
+
+    for (uint32_t id = 0; id < a.symbols.size(); id++) {
+        if (a.symbols.name(id) != b.symbols.name(id))
+            return false;
+    }
+
+    if (a.state.lineFound != b.state.lineFound || a.state.error != b.state.error
+        || a.state.diagnostics.size() != b.state.diagnostics.size())
+        return false;
+
+    for (size_t i = 0; i < a.state.diagnostics.size(); i++) {
+        if (a.state.diagnostics[i].lineFound != b.state.diagnostics[i].lineFound
+            || std::string_view(a.state.diagnostics[i].message) != b.state.diagnostics[i].message)
+            return false;
+    }
+
+    return true;
+}
+
+void serial(const std::string &code, Lexed &lexed) {
+    CCA::lexChunk(code, true, lexed.state, lexed.symbols, [&lexed](const CCA::Token &t) {
+        lexed.tokens.push(t);
+    });
+}
+
+void checkJobs(const std::string &code) {
+    Lexed expected;
+    serial(code, expected);
+
+    std::vector<CCA::LexedChunk> chunks;
+
+    for (unsigned int jobs: {2, 3, 4, 8}) {
+        Lexed lexed;
+        CCA::lexParallel(code, jobs, lexed.state, lexed.symbols, lexed.tokens, chunks);
+        CHECK(same(lexed, expected));
+    }
+}
+
+int main() {
+    const size_t CHUNK = CCA::PARALLEL_LEX_MIN_CHUNK;
+    std::string code = generateSource(8 * CHUNK / 300, true);
+
+    checkJobs(code);
+
+    // a string with newlines in it that covers several of the splits, so the pieces after it are lexed as code
+    // first and have to be lexed again, and one with escapes that are decoded into the pools of the chunks
+    std::string lines;
+
+    for (size_t i = 0; lines.size() < 3 * CHUNK; i++)
+        lines += "MOV a, " + std::to_string(i) + " ; not code\n";
+
+    checkJobs(code.substr(0, code.size() / 3) + "def long \"" + lines + "\"\n" + code.substr(code.size() / 3)
+              + "def escaped \"tab\\tline\\n\"\nMOV b, escaped\n");
+
+    // quotes in comments and a string that is never closed
+    std::string quotes;
+
+    while (quotes.size() < 4 * CHUNK)
+        quotes += "MOV a, 1 ; it's \"quoted\n";
+
+    checkJobs(quotes);
+    checkJobs(quotes + "def open \"" + lines);
+
+    // errors are reported on the lines they are on, in order
+    std::string errors;
+
+    for (size_t i = 0; errors.size() < 4 * CHUNK; i++)
+        errors += i % 997 == 0 ? "MOV a, 0x\nMOV b, 99999999999\n" : "MOV a, 1\n";
+
+    checkJobs(errors);
+
+    return report("lexer");
+}
@@ -0,0 +1,133 @@
+#!/bin/sh
+# assembles objects with cca -c and links them with ccld, run from the repository root after `make build`
+
+cca="$PWD/cca"
+ccld="$PWD/ccld"
+work=$(mktemp -d)
+failures=0
+
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+
+# runs the command and fails the test when it does not exit with the expected status
+expect() {
+    expected=$1
+    description=$2
+    shift 2
+
+    if "$@" > output.txt 2>&1; then
+        outcome=ok
+    else
+        outcome=error
+    fi
+
+    if [ "$outcome" != "$expected" ]; then
+        echo "  failed: $description"
+        sed 's/^/    /' output.txt
+        failures=$((failures + 1))
+    fi
+}
+
+printf 'CALL ext\nSTP\n' > main.cca
+printf '%%global ext\n:ext\nMOV a, b\nRET &0\n' > ext.cca
+
+expect ok "assembling objects" "$cca" -s -c main.cca -o main.cco
+expect ok "assembling objects" "$cca" -s -c ext.cca -o ext.cco
+expect ok "linking objects" "$ccld" -s main.cco ext.cco -o linked.ccb
+
+# an operand count no encoding takes, whatever the other object declares ext as, is an error of the assembler
+# and never reaches ccld as a relocation it can't read
+printf 'MOV a, b, ext\nSTP\n' > bad.cca
+printf 'PSH a, ext\nSTP\n' > worse.cca
+
+expect error "assembling an instruction with too many operands" "$cca" -s -c bad.cca -o bad.cco
+expect error "assembling an instruction without an encoding" "$cca" -s -c worse.cca -o worse.cco
+expect error "linking an object that was not written" "$ccld" -s bad.cco ext.cco -o bad.ccb
+
+if [ -e bad.cco ] || [ -e worse.cco ]; then
+    echo "  failed: objects were written for sources with errors"
+    failures=$((failures + 1))
+fi
+
+# markers and definitions that are not exported stay inside their object, so both objects can have a loop and a
+# text of their own. linked, they are the same program as their sources assembled as one with the names made unique
+cat > first.cca << 'END'
+%global start
+%global shared
+def text "first"
+def shared "shared"
+:start
+MOV b, text
+MOV c, loop
+JMP skip
+:loop
+ADD a, 1
+JNE loop
+:skip
+CALL second
+STP
+END
+
+cat > second.cca << 'END'
+%global second
+def text "second"
+:second
+MOV b, text
+MOV d, shared
+:loop
+ADD a, 1
+JNE loop
+MOV c, loop
+RET &0
+END
+
+expect ok "assembling objects with the same local names" "$cca" -s -c first.cca -o first.cco
+expect ok "assembling objects with the same local names" "$cca" -s -c second.cca -o second.cco
+expect ok "linking objects with the same local names" "$ccld" -s first.cco second.cco -o program.ccb
+
+sed -e 's/text/firstText/g' -e 's/loop/firstLoop/g' first.cca > whole.cca
+sed -e 's/text/secondText/g' -e 's/loop/secondLoop/g' second.cca >> whole.cca
+
+expect ok "assembling wide objects" "$cca" -s -c --wide first.cca -o first.cco
+expect ok "assembling wide objects" "$cca" -s -c --wide second.cca -o second.cco
+expect ok "linking wide objects" "$ccld" -s first.cco second.cco -o program.ccb
+expect ok "assembling the sources as one" "$cca" -s -p --wide whole.cca -o whole.ccb
+expect ok "linking gives the same program as assembling the sources as one" cmp program.ccb whole.ccb
+
+# names that are not exported can't be used by other objects, and only declared names can be exported
+printf 'CALL loop\nSTP\n' > hidden.cca
+printf '%%global missing\nSTP\n' > missing.cca
+
+expect ok "assembling a reference to another object" "$cca" -s -c hidden.cca -o hidden.cco
+expect error "linking a reference to a name that is not exported" "$ccld" -s hidden.cco second.cco -o hidden.ccb
+expect error "exporting a name that is not declared" "$cca" -s -c missing.cca -o missing.cco
+
+# mnemonics and registers are matched in any case, so they can't name a marker or a definition in either mode
+printf 'CALL sub\nSTP\n:sub\nRET &0\n' > reserved.cca
+printf 'def Pop "x"\nMOV a, Pop\nSTP\n' > register.cca
+
+expect error "naming a marker after a mnemonic" "$cca" -s reserved.cca -o reserved.ccb
+expect error "naming a marker after a mnemonic" "$cca" -s -p reserved.cca -o reserved.ccb
+expect error "naming a definition after a mnemonic" "$cca" -s register.cca -o register.ccb
+expect error "naming a definition after a mnemonic" "$cca" -s -p register.cca -o register.ccb
+
+# errors in an included file name that file and the line in it, in both modes
+printf 'MOV a, 1\nMOV b, 2\nMOV c, 3\nMOV d, 4\n%%include "lib.cca"\nSTP\n' > including.cca
+printf 'JMP nowhere\n' > lib.cca
+
+for mode in --single-pass --jobs=1; do
+    expect error "referencing an unknown name in an included file" "$cca" -s $mode including.cca -o including.ccb
+
+    if ! grep -q "'nowhere' on lib.cca:1" output.txt; then
+        echo "  failed: the error in the included file names lib.cca:1 with $mode"
+        sed 's/^/    /' output.txt
+        failures=$((failures + 1))
+    fi
+done
+
+if [ $failures -ne 0 ]; then
+    echo "link: $failures checks failed"
+    exit 1
+fi
+
+echo "link: passed"
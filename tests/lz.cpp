@@ -0,0 +1,110 @@
+// round trips data of every shape through the Lz codec and checks that malformed streams are rejected before they
+// can make the decompressor allocate or read more than the stream accounts for
+
+#include "test.h"
+
+#include <random>
+
+using Bytes = std::vector<unsigned char>;
+
+void pushNumber(Bytes &stream, uint64_t value, unsigned int width) {
+    for (unsigned int i = 0; i < width; i++)
+        stream.push_back((value >> (8 * (width - 1 - i))) & 0xFF);
+}
+
+// a stream header followed by the block sizes and enough zeroes to match them
+Bytes header(uint64_t total, uint32_t blockSize, uint32_t blocks, uint32_t blockBytes = 4) {
+    Bytes stream;
+    pushNumber(stream, total, 8);
+    pushNumber(stream, blockSize, 4);
+    pushNumber(stream, blocks, 4);
+
+    for (uint32_t i = 0; i < blocks; i++)
+        pushNumber(stream, blockBytes, 4);
+
+    stream.resize(stream.size() + blocks * blockBytes);
+    return stream;
+}
+
+bool roundTrips(const Bytes &data, size_t blockSize, unsigned int jobs) {
+    Bytes compressed = CCA::Lz::compress(data.data(), data.size(), blockSize);
+    Bytes output;
+
+    return CCA::Lz::decompress(compressed.data(), compressed.size(), output, jobs) && output == data;
+}
+
+int main() {
+    const size_t BLOCK = CCA::Lz::BLOCK_SIZE;
+    std::mt19937 random(1234);
+
+    std::vector<Bytes> inputs;
+
+    for (size_t size: {size_t(0), size_t(1), size_t(3), size_t(4), size_t(5), size_t(19), size_t(300), BLOCK - 1,
+                       BLOCK, BLOCK + 1, 3 * BLOCK + 7}) {
+        Bytes zeroes(size, 0);
+        Bytes noise(size);
+        Bytes text(size);
+        std::string source = generateSource(size / 200 + 1);
+
+        for (auto &byte: noise)
+            byte = random();
+
+        for (size_t i = 0; i < size; i++)
+            text[i] = source[i % source.size()];
+
+        inputs.push_back(zeroes);
+        inputs.push_back(noise);
+        inputs.push_back(text);
+    }
+
+    for (const Bytes &input: inputs) {
+        CHECK(roundTrips(input, BLOCK, 1));
+        CHECK(roundTrips(input, BLOCK, 4));
+        CHECK(roundTrips(input, 1000, 3));
+    }
+
+    Bytes output;
+
+    // too short for a header, or blocks of no size
+    CHECK(!CCA::Lz::decompress(nullptr, 0, output));
+    CHECK(!CCA::Lz::decompress(header(0, 0, 0).data(), 16, output));
+
+    // blocks larger than any writer uses, even when the stream would otherwise add up
+    Bytes large = header(4, 0xFFFFFFFFu, 1);
+    CHECK(!CCA::Lz::decompress(large.data(), large.size(), output));
+
+    // tiny streams claiming gigabytes or just more than they hold, turned down before the output is allocated
+    Bytes gigabytes = header(uint64_t(4) << 30, 1u << 30, 4);
+    Bytes megabyte = header(4 * BLOCK, BLOCK, 4);
+    CHECK(!CCA::Lz::decompress(gigabytes.data(), gigabytes.size(), output));
+    CHECK(!CCA::Lz::decompress(megabyte.data(), megabyte.size(), output));
+    CHECK(output.capacity() == 0);
+
+    // sizes that would wrap the block count to zero
+    Bytes wrapping = header(~uint64_t(0), BLOCK, 0);
+    CHECK(!CCA::Lz::decompress(wrapping.data(), wrapping.size(), output));
+
+    // more data than the compressed bytes could expand to
+    Bytes expanded = header(BLOCK, BLOCK, 1, 16);
+    CHECK(!CCA::Lz::decompress(expanded.data(), expanded.size(), output));
+
+    // every cut of a valid stream is rejected, and damaged bytes never make it decode to the wrong size
+    std::string source = generateSource(10);
+    Bytes sample(source.begin(), source.end());
+    Bytes compressed = CCA::Lz::compress(sample.data(), sample.size());
+
+    for (size_t size = 0; size < compressed.size(); size++)
+        CHECK(!CCA::Lz::decompress(compressed.data(), size, output));
+
+    for (size_t i = 0; i < compressed.size(); i++) {
+        for (unsigned char flip: {0x01, 0x80, 0xFF}) {
+            Bytes damaged = compressed;
+            damaged[i] ^= flip;
+
+            if (CCA::Lz::decompress(damaged.data(), damaged.size(), output))
+                CHECK(output.size() == sample.size());
+        }
+    }
+
+    return report("lz");
+}
@@ -0,0 +1,107 @@
+// assembles the same source with the batch pipeline, with --single-pass and with --pipeline, from memory and from a
+// pipe, with and without the wide forms, and checks that all of them write the same bytes
+
+#include "test.h"
+
+struct Output {
+    std::vector<unsigned char> bytecode;
+    std::vector<char> data;
+
+    bool operator==(const Output &other) const {
+        return bytecode == other.bytecode && data == other.data;
+    }
+};
+
+// the passes of assembleFile, watch mode hands the same workspace to every build
+Output batch(const std::string &code, unsigned int jobs, CCA::Workspace &workspace, bool wide = true) {
+    Output output;
+
+    workspace.reset(wide, false);
+    CCA::lexer(code, workspace.symbols, workspace.tokens, jobs, workspace.chunks, workspace.buffers);
+    CCA::parseDefinitions(workspace.tokens, workspace.definitions);
+    CCA::postTokenizer(workspace.tokens, workspace.markers, workspace.definitions, workspace.symbols,
+                       workspace.table, workspace.buffers);
+    CCA::layoutInstructions(workspace.tokens, workspace.markers, wide, workspace.instructions, jobs,
+                            workspace.buffers);
+    CCA::generateBytecode(workspace.tokens, workspace.instructions, wide, workspace.symbols, output.bytecode, jobs,
+                          workspace.buffers);
+    output.data = CCA::dataSection(workspace.definitions);
+
+    return output;
+}
+
+Output batch(const std::string &code, unsigned int jobs, bool wide = true) {
+    CCA::Workspace workspace;
+    return batch(code, jobs, workspace, wide);
+}
+
+template <typename Lexer, typename Input>
+Output stream(Input input, bool wide) {
+    CCA::StreamAssembler assembler(wide);
+    CCA::LexState state;
+    Output output;
+
+    {
+        Lexer lexed(input, state, assembler.getSymbols());
+        CCA::DeclarationFilter<Lexer, CCA::StreamAssembler> declared(lexed, assembler);
+
+        assembler.consume(declared);
+        declared.finish();
+    }
+
+    assembler.finish();
+
+    output.bytecode = assembler.getBytecode();
+    output.data = CCA::dataSection(assembler.getDefinitions());
+
+    return output;
+}
+
+// a pipe is read a chunk at a time, the file stands in for one
+template <typename Lexer>
+Output piped(const std::string &code, bool wide) {
+    FILE *input = std::tmpfile();
+    std::fwrite(code.data(), 1, code.size(), input);
+    std::rewind(input);
+
+    Output output = stream<Lexer>(input, wide);
+    std::fclose(input);
+
+    return output;
+}
+
+int main() {
+    // strings longer than the window of the pull lexer and than a chunk read from a pipe, in between the usual code
+    std::string code = generateSource(6000, true);
+    code.insert(code.find("def message2000 "), "def long \"" + std::string(10000, 'x') + "\"\nMOV a, long\n");
+    code.insert(code.find("def message4000 "), "def longer \"" + std::string(3 << 20, 'y') + "\"\nMOV b, longer\n");
+
+    Output expected = batch(code, 1);
+
+    CHECK(batch(code, 4) == expected);
+
+    // rebuilds reuse the chunks, pools and tables of the one before, whatever it assembled
+    std::string small = generateSource(50);
+    Output smallExpected = batch(small, 1);
+    CCA::Workspace workspace;
+
+    for (unsigned int jobs: {4, 1, 4}) {
+        CHECK(batch(code, jobs, workspace) == expected);
+        CHECK(batch(small, jobs, workspace) == smallExpected);
+    }
+    CHECK(stream<CCA::TokenGenerator>(std::string_view(code), true) == expected);
+    CHECK(stream<CCA::PipelinedLexer>(std::string_view(code), true) == expected);
+    CHECK(piped<CCA::TokenGenerator>(code, true) == expected);
+    CHECK(piped<CCA::PipelinedLexer>(code, true) == expected);
+
+    // without them forward branches and references to definitions get their short forms in both modes
+    Output narrow = batch(code, 1, false);
+
+    CHECK(narrow.bytecode.size() < expected.bytecode.size());
+    CHECK(stream<CCA::TokenGenerator>(std::string_view(code), false) == narrow);
+    CHECK(stream<CCA::PipelinedLexer>(std::string_view(code), false) == narrow);
+    CHECK(piped<CCA::TokenGenerator>(code, false) == narrow);
+    CHECK(piped<CCA::PipelinedLexer>(code, false) == narrow);
+
+    return report("modes");
+}
@@ -0,0 +1,86 @@
+// checks that the vectorized scanners find the same positions and count the same newlines as the scalar loops, on
+// every offset and length around the vector widths, and that the lexer gives the same tokens with each of them
+
+#include "test.h"
+
+#include <random>
+
+const std::pair<const char *, CCA::Scan::Level> levels[] = {
+        {"sse2", CCA::Scan::Level::SSE2},
+        {"avx2", CCA::Scan::Level::AVX2}
+};
+
+// text made of the characters the scanners look for, mostly blanks so that whitespace runs get long
+std::string randomText(std::mt19937 &random, size_t size) {
+    const char alphabet[] = "    \t\t\r\n\n\n'\"\\;a";
+    std::string text(size, ' ');
+
+    for (char &c: text)
+        c = alphabet[random() % (sizeof(alphabet) - 1)];
+
+    return text;
+}
+
+void checkScanners(const CCA::Scan::Scanner &scanner, const std::string &text) {
+    const CCA::Scan::Scanner scalar = CCA::Scan::scannerFor(CCA::Scan::Level::SCALAR);
+
+    for (size_t begin = 0; begin < 40 && begin <= text.size(); begin++) {
+        for (size_t end = begin; end <= text.size(); end++) {
+            const char *p = text.data() + begin;
+            const char *e = text.data() + end;
+            int expectedLines = 0, lines = 0;
+
+            CHECK(scanner.skipWhitespace(p, e, lines) == scalar.skipWhitespace(p, e, expectedLines));
+            CHECK(lines == expectedLines);
+            CHECK(scanner.findByte(p, e, '\n') == scalar.findByte(p, e, '\n'));
+            CHECK(scanner.findByte(p, e, '\\') == scalar.findByte(p, e, '\\'));
+            CHECK(scanner.findEither(p, e, '\'', '"') == scalar.findEither(p, e, '\'', '"'));
+        }
+    }
+}
+
+bool sameTokens(const CCA::TokenStore &a, const CCA::TokenStore &b) {
+    return a.types == b.types && a.lines == b.lines && a.values == b.values && a.spans == b.spans;
+}
+
+int main() {
+    std::mt19937 random(1234);
+
+    for (auto &level: levels) {
+        if (level.second > CCA::Scan::detectLevel()) {
+            std::cout << "  " << level.first << " is not supported here, skipped\n";
+            continue;
+        }
+
+        CCA::Scan::Scanner scanner = CCA::Scan::scannerFor(level.second);
+
+        for (int run = 0; run < 20; run++)
+            checkScanners(scanner, randomText(random, 100));
+
+        // a long run of blanks that ends at every position within the vectors
+        for (size_t size = 0; size < 80; size++)
+            checkScanners(scanner, std::string(size, '\n') + "x");
+    }
+
+    std::string code = generateSource(2000, true) + "def escaped \"tab\\tline\\n \\x41\"\n";
+    CCA::SymbolPool scalarSymbols;
+    CCA::TokenStore scalarTokens;
+
+    CCA::Scan::useLevel(CCA::Scan::Level::SCALAR);
+    CCA::lexer(code, scalarSymbols, scalarTokens);
+
+    for (auto &level: levels) {
+        CCA::SymbolPool symbols;
+        CCA::TokenStore tokens;
+
+        CCA::Scan::useLevel(level.second);
+        CCA::lexer(code, symbols, tokens);
+
+        CHECK(sameTokens(tokens, scalarTokens));
+        CHECK(symbols.size() == scalarSymbols.size());
+    }
+
+    CCA::Scan::useLevel(CCA::Scan::detectLevel());
+
+    return report("scan");
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// the checks the tests are written with. a failed check is reported with its line and the test goes on, so one
+// run shows every failure, the exit code of the test says whether there were any
+// build and run all of them with `make test`
+
+#include "generate.h"
+
+int failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __FILE__, __LINE__)
+
+bool check(bool passed, const char *condition, const char *file, int line) {
+    if (!passed) {
+        std::cout << "  " << file << ":" << line << ": failed " << condition << "\n";
+        ++failures;
+    }
+
+    return passed;
+}
+
+// prints the result of the test and returns the exit code for main
+int report(const char *name) {
+    if (failures)
+        std::cout << name << ": " << failures << " checks failed\n";
+    else
+        std::cout << name << ": passed\n";
+
+    return failures ? 1 : 0;
+}